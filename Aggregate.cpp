@@ -0,0 +1,160 @@
+/////////////////////////////////////////////////////////////////////////////////////////
+//    This file is part of Solar.
+//
+//    Copyright (C) 2021 Matthias Hund
+//    
+//    This program is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU General Public License
+//    as published by the Free Software Foundation; either version 2
+//    of the License, or (at your option) any later version.
+//    
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//    
+//    You should have received a copy of the GNU General Public License
+//    along with this program; if not, write to the Free Software
+//    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+/////////////////////////////////////////////////////////////////////////////////////////
+#include "ExtEeprom.h"
+#include "Aggregate.h"
+
+struct AggregateAcc
+{
+  uint16_t min;
+  uint16_t max;
+  uint32_t sum;
+  uint16_t count;
+};
+
+static const uint32_t gcPeriodSeconds[AGG_PERIODS] = {3600ul,86400ul};
+
+static AggregateAcc     gAcc[AGG_PERIODS][AGG_CHANNELS];
+static uint32_t         gPeriodTime[AGG_PERIODS]  = {0ul,0ul};
+static uint16_t         gPeriodCount[AGG_PERIODS] = {0u,0u};
+
+static void AggregateReset(AggregateAcc &acc);
+static void AggregateRecord(const AGG_PERIOD period,const uint16_t number,const uint32_t seconds,uint8_t record[]);
+static void AggregateStore(const AGG_PERIOD period);
+
+static void AggregateReset(AggregateAcc &acc)
+{
+  acc.min   = 0xFFFFu;
+  acc.max   = 0u;
+  acc.sum   = 0ul;
+  acc.count = 0u;
+}
+
+/*
+ * build the record of a period from its running values
+ */
+static void AggregateRecord(const AGG_PERIOD period,const uint16_t number,const uint32_t seconds,uint8_t record[])
+{
+  uint8_t idx = 0u;
+
+  memcpy(&(record[idx]),&number,sizeof(number));
+  idx += sizeof(number);
+  memcpy(&(record[idx]),&seconds,sizeof(seconds));
+  idx += sizeof(seconds);
+
+  for(uint8_t ch=0u;ch<AGG_CHANNELS;ch++)
+  {
+    const AggregateAcc &acc = gAcc[period][ch];
+    uint16_t values[4] = {0u,0u,0u,0u};  // min, max, mean, count
+    if(acc.count>0u)
+    {
+      values[0] = acc.min;
+      values[1] = acc.max;
+      values[2] = (acc.sum+acc.count/2u)/acc.count;
+      values[3] = acc.count;
+    }
+    memcpy(&(record[idx]),values,sizeof(values));
+    idx += sizeof(values);
+  }
+}
+
+/*
+ * write the record of a completed period to its page at the end of the eeprom
+ * and start a new period.
+ */
+static void AggregateStore(const AGG_PERIOD period)
+{
+  uint8_t record[gcAggregateRecordSize];
+
+  gPeriodCount[period]++;
+  AggregateRecord(period,gPeriodCount[period],gcPeriodSeconds[period],record);
+  for(uint8_t ch=0u;ch<AGG_CHANNELS;ch++)
+  {
+    AggregateReset(gAcc[period][ch]);
+  }
+
+  const uint32_t addr = static_cast<uint32_t>(EEPROM_I2C_pages()-gcEepromAggregatePages+period)*gcEepromPageSize;
+  EEPROM_I2C_write(addr,record,sizeof(record));
+}
+
+void AggregateAddSample(const AGG_CHANNEL channel,const uint16_t value)
+{
+  for(uint8_t period=0u;period<AGG_PERIODS;period++)
+  {
+    AggregateAcc &acc = gAcc[period][channel];
+    if(acc.count==0u)
+    {
+      AggregateReset(acc);
+    }
+    if(value<acc.min)
+      acc.min = value;
+    if(value>acc.max)
+      acc.max = value;
+    acc.sum += value;
+    acc.count++;
+  }
+}
+
+/*
+ * advance the aggregation clock by the time passed since the last call. A long
+ * call may complete several periods, the ones without samples are stored empty.
+ */
+void AggregateTick(const uint32_t seconds)
+{
+  for(uint8_t period=0u;period<AGG_PERIODS;period++)
+  {
+    gPeriodTime[period] += seconds;
+    while(gPeriodTime[period] >= gcPeriodSeconds[period])
+    {
+      gPeriodTime[period] -= gcPeriodSeconds[period];
+      AggregateStore(static_cast<AGG_PERIOD>(period));
+    }
+  }
+}
+
+/*
+ * read the records of the last completed hour and day into data, followed by
+ * the running hour and day with the seconds elapsed so far.
+ * a period not completed since power up reads as zeros, the eeprom page
+ * still holds data of an earlier run or is erased.
+ * returns the number of bytes read.
+ */
+uint8_t AggregateRead(uint8_t data[],const uint8_t dataSize)
+{
+  uint8_t n = 0u;
+  for(uint8_t period=0u;period<AGG_PERIODS and n+gcAggregateRecordSize<=dataSize;period++)
+  {
+    if(gPeriodCount[period]==0u)
+    {
+      memset(&(data[n]),0,gcAggregateRecordSize);
+      n += gcAggregateRecordSize;
+    }
+    else
+    {
+      const uint32_t addr = static_cast<uint32_t>(EEPROM_I2C_pages()-gcEepromAggregatePages+period)*gcEepromPageSize;
+      n += EEPROM_I2C_read(addr,&(data[n]),gcAggregateRecordSize);
+    }
+  }
+  for(uint8_t period=0u;period<AGG_PERIODS and n+gcAggregateRecordSize<=dataSize;period++)
+  {
+    AggregateRecord(static_cast<AGG_PERIOD>(period),gPeriodCount[period]+1u,gPeriodTime[period],&(data[n]));
+    n += gcAggregateRecordSize;
+  }
+  return n;
+}
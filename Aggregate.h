@@ -0,0 +1,43 @@
+/////////////////////////////////////////////////////////////////////////////////////////
+//    This file is part of Solar.
+//
+//    Copyright (C) 2021 Matthias Hund
+//    
+//    This program is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU General Public License
+//    as published by the Free Software Foundation; either version 2
+//    of the License, or (at your option) any later version.
+//    
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//    
+//    You should have received a copy of the GNU General Public License
+//    along with this program; if not, write to the Free Software
+//    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+/////////////////////////////////////////////////////////////////////////////////////////
+#ifndef AGGREGATE_H
+#define AGGREGATE_H
+
+#include "Arduino.h"
+#include "Global.h"
+
+enum AGG_CHANNEL      {AGG_LIGHT,AGG_LIGHT_PRESCALED,AGG_USOL,AGG_PRESSURE,AGG_TEMPERATURE,AGG_HUMIDITY,AGG_UBAT,AGG_CHANNELS};
+enum AGG_PERIOD       {AGG_HOUR,AGG_DAY,AGG_PERIODS};
+
+/*
+ * record of a period: uint16_t number of the period since power up and
+ * uint32_t seconds covered, followed by min, max, mean and count (uint16_t
+ * each) for every channel. A period not completed since power up has number 0
+ * and is all zeros.
+ * light is split by the state of the lum prescaler: both channels hold the
+ * raw lum value, their counts give the share of each state.
+ */
+const uint8_t gcAggregateRecordSize = 2u+4u+AGG_CHANNELS*4u*2u;
+
+void      AggregateAddSample(const AGG_CHANNEL channel,const uint16_t value);
+void      AggregateTick(const uint32_t seconds);
+uint8_t   AggregateRead(uint8_t data[],const uint8_t dataSize);
+
+#endif // AGGREGATE_H
@@ -0,0 +1,291 @@
+/////////////////////////////////////////////////////////////////////////////////////////
+//    This file is part of Solar.
+//
+//    Copyright (C) 2021 Matthias Hund
+//    
+//    This program is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU General Public License
+//    as published by the Free Software Foundation; either version 2
+//    of the License, or (at your option) any later version.
+//    
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//    
+//    You should have received a copy of the GNU General Public License
+//    along with this program; if not, write to the Free Software
+//    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+/////////////////////////////////////////////////////////////////////////////////////////
+#include "ExtEeprom.h"
+#include "Compaction.h"
+
+struct CompactRecord
+{
+  uint16_t stamp;
+  uint8_t  span;
+  uint16_t light[2];  // min, max, bit 10 = prescaler
+  uint16_t lum[2];    // mean with prescaler off, on
+  uint8_t  lumShare;  // share of samples with prescaler on, 0..gcShareMax
+  uint16_t usol;
+  uint16_t pressure;
+  uint16_t temp[3];   // min, max, mean
+  uint8_t  humidity;
+  uint16_t ubat;
+};
+
+static const uint16_t   gcMarker        = 0xFFFu;
+static const uint8_t    gcMarkerBits    = 12u;
+static const uint8_t    gcShareMax      = 63u;
+
+static CompactRecord    gRecords[gcCompactRecords];
+static uint8_t          gRecordCount    = 0u;
+static uint8_t          gSpan           = 1u;   // span of the records of the page being built
+
+static uint16_t         ReadBits(const uint8_t page[],uint16_t &bitIdx,const uint8_t bits);
+static void             WriteBits(uint8_t page[],uint16_t &bitIdx,const uint16_t data,const uint8_t bits);
+static uint16_t         WeightedMean(const uint16_t a,const uint16_t wa,const uint16_t b,const uint16_t wb);
+static void             MergeRecords(CompactRecord &a,const CompactRecord &b);
+static void             AddRecord(const CompactRecord &rec);
+static void             ReadRawPage(const uint8_t page[],CompactRecord &rec);
+static void             ReadCompactPage(const uint8_t page[]);
+
+static uint16_t ReadBits(const uint8_t page[],uint16_t &bitIdx,const uint8_t bits)
+{
+  uint16_t data = 0u;
+  for(uint8_t i=0u;i<bits;i++,bitIdx++)
+  {
+    data = (data<<1u) | ((page[bitIdx/8u] >> (7u-bitIdx%8u)) & 1u);
+  }
+  return data;
+}
+
+static void WriteBits(uint8_t page[],uint16_t &bitIdx,const uint16_t data,const uint8_t bits)
+{
+  uint8_t i = bits;
+  while(i!=0)
+  {
+    i--;
+    if((data & (1u<<i)) != 0u)
+    {
+      page[bitIdx/8u] |= (0x80u >> (bitIdx%8u));
+    }
+    bitIdx++;
+  }
+}
+
+static uint16_t WeightedMean(const uint16_t a,const uint16_t wa,const uint16_t b,const uint16_t wb)
+{
+  const uint32_t w = static_cast<uint32_t>(wa)+wb;
+  if(w==0u)
+    return 0u;
+  return (static_cast<uint32_t>(a)*wa+static_cast<uint32_t>(b)*wb+w/2u)/w;
+}
+
+/*
+ * merge record b into the record a directly preceding it
+ */
+static void MergeRecords(CompactRecord &a,const CompactRecord &b)
+{
+  if(b.light[0]<a.light[0])
+    a.light[0] = b.light[0];
+  if(b.light[1]>a.light[1])
+    a.light[1] = b.light[1];
+  if(b.temp[0]<a.temp[0])
+    a.temp[0] = b.temp[0];
+  if(b.temp[1]>a.temp[1])
+    a.temp[1] = b.temp[1];
+
+  // the lum means only cover the samples taken with the respective prescaler state
+  a.lum[0]    = WeightedMean(a.lum[0],a.span*(gcShareMax-a.lumShare),b.lum[0],b.span*(gcShareMax-b.lumShare));
+  a.lum[1]    = WeightedMean(a.lum[1],a.span*a.lumShare             ,b.lum[1],b.span*b.lumShare);
+  a.lumShare  = WeightedMean(a.lumShare,a.span,b.lumShare,b.span);
+  a.usol      = WeightedMean(a.usol    ,a.span,b.usol    ,b.span);
+  a.pressure  = WeightedMean(a.pressure,a.span,b.pressure,b.span);
+  a.temp[2]   = WeightedMean(a.temp[2] ,a.span,b.temp[2] ,b.span);
+  a.humidity  = WeightedMean(a.humidity,a.span,b.humidity,b.span);
+  a.ubat      = WeightedMean(a.ubat    ,a.span,b.ubat    ,b.span);
+
+  a.span  = a.span+b.span;
+  a.stamp = b.stamp;
+}
+
+/*
+ * add a record to the last one if that one has not reached the span of the
+ * page yet and rec directly follows it, else start a new record
+ */
+static void AddRecord(const CompactRecord &rec)
+{
+  if(gRecordCount>0u)
+  {
+    CompactRecord &last = gRecords[gRecordCount-1u];
+    if(last.span<gSpan and static_cast<uint16_t>(rec.stamp-last.stamp)==rec.span)
+    {
+      MergeRecords(last,rec);
+      return;
+    }
+  }
+  if(gRecordCount<gcCompactRecords)
+  {
+    gRecords[gRecordCount] = rec;
+    gRecordCount++;
+  }
+}
+
+/*
+ * summarize a raw page. The layout follows WhatNeedsToBeWritten() in Solar.ino:
+ * one page holds the 200 calls of one cycle.
+ */
+static void ReadRawPage(const uint8_t page[],CompactRecord &rec)
+{
+  uint16_t bitIdx     = 0u;
+  uint16_t lumSum[2]  = {0u,0u};
+  uint8_t  lumCount[2]= {0u,0u};
+  uint32_t usolSum    = 0ul;
+  uint32_t presSum    = 0ul;
+  uint32_t tempSum    = 0ul;
+  uint8_t  usolCount  = 0u;
+  uint8_t  tempCount  = 0u;
+
+  rec.light[0] = 0xFFFFu;
+  rec.light[1] = 0u;
+  rec.temp[0]  = 0xFFFFu;
+  rec.temp[1]  = 0u;
+
+  for(uint8_t callCount=10u;callCount<=200u;callCount+=10u)
+  {
+    const uint16_t lum        = ReadBits(page,bitIdx,10u);
+    const uint16_t prescaler  = ReadBits(page,bitIdx,2u);
+    const uint16_t light      = (prescaler<<10u)|lum;
+    if(light<rec.light[0])
+      rec.light[0] = light;
+    if(light>rec.light[1])
+      rec.light[1] = light;
+    lumSum[prescaler & 1u]   += lum;
+    lumCount[prescaler & 1u]++;
+
+    if(callCount%20u == 0)
+    {
+      usolSum += ReadBits(page,bitIdx,10u);
+      presSum += ReadBits(page,bitIdx,10u);
+      usolCount++;
+    }
+    if(callCount%50u == 0)
+    {
+      const uint16_t temp = ReadBits(page,bitIdx,10u);
+      if(temp<rec.temp[0])
+        rec.temp[0] = temp;
+      if(temp>rec.temp[1])
+        rec.temp[1] = temp;
+      tempSum += temp;
+      tempCount++;
+
+      if(callCount == 200)
+      {
+        rec.humidity = ReadBits(page,bitIdx,8u);
+        ReadBits(page,bitIdx,8u);   // housing temperature
+        ReadBits(page,bitIdx,2u);   // power status
+        rec.ubat     = ReadBits(page,bitIdx,10u);
+      }
+    }
+  }
+
+  for(uint8_t j=0u;j<2u;j++)
+  {
+    rec.lum[j]  = (lumCount[j]>0u) ? (lumSum[j]+lumCount[j]/2u)/lumCount[j] : 0u;
+  }
+  const uint8_t samples = lumCount[0]+lumCount[1];
+  rec.lumShare  = (lumCount[1]*gcShareMax+samples/2u)/samples;
+  rec.usol      = (usolSum +usolCount/2u) /usolCount;
+  rec.pressure  = (presSum +usolCount/2u) /usolCount;
+  rec.temp[2]   = (tempSum +tempCount/2u) /tempCount;
+  rec.span      = 1u;
+}
+
+static void ReadCompactPage(const uint8_t page[])
+{
+  uint16_t bitIdx = gcMarkerBits;
+  for(uint8_t i=0u;i<gcCompactRecords;i++)
+  {
+    CompactRecord rec;
+    rec.stamp     = ReadBits(page,bitIdx,16u);
+    rec.span      = ReadBits(page,bitIdx,8u);
+    for(uint8_t j=0u;j<2u;j++)
+      rec.light[j] = ReadBits(page,bitIdx,11u);
+    for(uint8_t j=0u;j<2u;j++)
+      rec.lum[j]   = ReadBits(page,bitIdx,10u);
+    rec.lumShare  = ReadBits(page,bitIdx,6u);
+    rec.usol      = ReadBits(page,bitIdx,10u);
+    rec.pressure  = ReadBits(page,bitIdx,10u);
+    for(uint8_t j=0u;j<3u;j++)
+      rec.temp[j] = ReadBits(page,bitIdx,10u);
+    rec.humidity  = ReadBits(page,bitIdx,8u);
+    rec.ubat      = ReadBits(page,bitIdx,10u);
+
+    if(rec.span>0u)
+    {
+      AddRecord(rec);
+    }
+  }
+}
+
+bool CompactionIsCompactPage(const uint8_t page[])
+{
+  uint16_t bitIdx = 0u;
+  return (ReadBits(page,bitIdx,gcMarkerBits) == gcMarker);
+}
+
+/*
+ * start collecting records for a page whose records cover span cycles each
+ */
+void CompactionBegin(const uint8_t span)
+{
+  gSpan         = span;
+  gRecordCount  = 0u;
+}
+
+/*
+ * add the records of a page, pages are added oldest first. stamp is the cycle
+ * number of a raw page and is ignored for compact pages.
+ */
+void CompactionAddPage(const uint8_t page[],const uint16_t stamp)
+{
+  if(CompactionIsCompactPage(page))
+  {
+    ReadCompactPage(page);
+  }
+  else
+  {
+    CompactRecord rec;
+    ReadRawPage(page,rec);
+    rec.stamp = stamp;
+    AddRecord(rec);
+  }
+}
+
+/*
+ * write the collected records as compact page
+ */
+void CompactionEnd(uint8_t page[])
+{
+  uint16_t bitIdx = 0u;
+  memset(page,0,gcEepromPageSize);
+  WriteBits(page,bitIdx,gcMarker,gcMarkerBits);
+  for(uint8_t i=0u;i<gRecordCount;i++)
+  {
+    const CompactRecord &rec = gRecords[i];
+    WriteBits(page,bitIdx,rec.stamp,16u);
+    WriteBits(page,bitIdx,rec.span,8u);
+    for(uint8_t j=0u;j<2u;j++)
+      WriteBits(page,bitIdx,rec.light[j],11u);
+    for(uint8_t j=0u;j<2u;j++)
+      WriteBits(page,bitIdx,rec.lum[j],10u);
+    WriteBits(page,bitIdx,rec.lumShare,6u);
+    WriteBits(page,bitIdx,rec.usol,10u);
+    WriteBits(page,bitIdx,rec.pressure,10u);
+    for(uint8_t j=0u;j<3u;j++)
+      WriteBits(page,bitIdx,rec.temp[j],10u);
+    WriteBits(page,bitIdx,rec.humidity,8u);
+    WriteBits(page,bitIdx,rec.ubat,10u);
+  }
+}
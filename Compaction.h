@@ -0,0 +1,54 @@
+/////////////////////////////////////////////////////////////////////////////////////////
+//    This file is part of Solar.
+//
+//    Copyright (C) 2021 Matthias Hund
+//    
+//    This program is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU General Public License
+//    as published by the Free Software Foundation; either version 2
+//    of the License, or (at your option) any later version.
+//    
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//    
+//    You should have received a copy of the GNU General Public License
+//    along with this program; if not, write to the Free Software
+//    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+/////////////////////////////////////////////////////////////////////////////////////////
+#ifndef COMPACTION_H
+#define COMPACTION_H
+
+#include "Arduino.h"
+#include "Global.h"
+
+/*
+ * A compact page starts with the 12 bit marker 0xFFF which can not occur in a
+ * raw page (the light prescaler field is either 0 or 1). It is followed by
+ * gcCompactRecords records of 140 bits each, oldest first:
+ *   stamp      16 bit  cycle number of the last page that contributed
+ *   span        8 bit  number of pages that contributed, 0 = unused record
+ *   light      2 x 11 bit  min, max (bit 10 = prescaler, a prescaled value
+ *                      is always brighter than an unscaled one)
+ *   lum        2 x 10 bit  mean of the samples with prescaler off, on
+ *   lum share   6 bit  share of samples with prescaler on, 0..63
+ *   Usol       10 bit  mean
+ *   pressure   10 bit  mean
+ *   temperature 3 x 10 bit  min, max, mean
+ *   humidity    8 bit  mean
+ *   Ubat       10 bit  mean
+ * A raw page yields one record of span 1. Records are added oldest first and
+ * merged into the records of the page being built until they reach its span,
+ * so all records of a page cover the same number of cycles. Only records which
+ * are contiguous in time are merged: record i covers the cycles
+ * stamp[i]-span[i]+1 to stamp[i] and directly follows record i-1.
+ */
+const uint8_t gcCompactRecords = 3u;
+
+bool      CompactionIsCompactPage(const uint8_t page[]);
+void      CompactionBegin(const uint8_t span);
+void      CompactionAddPage(const uint8_t page[],const uint16_t stamp);
+void      CompactionEnd(uint8_t page[]);
+
+#endif // COMPACTION_H
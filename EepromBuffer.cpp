@@ -20,21 +20,210 @@
 
 #include "ExtEeprom.h"
 #include "EepromBuffer.h"
+#include "Compaction.h"
+
+/*
+ * The buffer is split into a ring of raw pages and gcCompactTiers rings of
+ * compact pages. Every ring is written at its head and emptied at its tail, so
+ * each one stays in time order:
+ *   raw ring   one page per cycle
+ *   tier 0     3 records of 1 cycle per page, made of the 3 oldest raw pages
+ *   tier n     3 records of 4^n cycles per page, made of the 4 oldest pages of tier n-1
+ * Data only moves on to the next tier when it is older than everything left
+ * in its ring, so the tiers hold disjoint and successive time ranges: the last
+ * tier the oldest, the raw ring the newest. When the last tier is full its
+ * oldest page is dropped.
+ */
+struct CompactTier
+{
+  uint16_t head;   // next page to write, relative to the start of the ring
+  uint16_t pages;  // pages not uploaded yet
+};
+
+static const uint8_t    gcCompactTiers  = 4u;  // record spans 1, 4, 16 and 64 cycles
+static const uint8_t    gcTierFactor    = 4u;  // pages of a tier merged into one page of the next tier
 
 static uint8_t          gBitIdx         = 0u;
 static uint8_t          gBitBuffer      = 0u;
-static uint16_t         gEepromMemAddr  = 0u;
+static uint32_t         gEepromMemAddr  = 0u;
+static uint16_t         gCycle          = 0u;  // number of completed raw pages
+static uint16_t         gTailCycle      = 0u;  // cycle of the oldest raw page not uploaded yet
+static uint16_t         gRawPages       = 0u;  // raw pages not uploaded yet
+static CompactTier      gTiers[gcCompactTiers];
+
+static uint16_t         RawRingPages();
+static uint16_t         TierRingPages();
+static uint8_t          TierSpan(const uint8_t tier);
+static uint32_t         RawPageAddr(const uint16_t page);
+static uint32_t         TierPageAddr(const uint8_t tier,const uint16_t page);
+static void             TierWrite(const uint8_t tier,uint8_t page[]);
+static void             TierMerge(const uint8_t tier);
+static bool             EepromBufferWrite(uint8_t data);
+static void             EepromBufferCompact();
+
+/*
+ * number of pages used for the ring buffers
+ */
+uint16_t  EepromBufferPages()
+{
+  return EEPROM_I2C_pages()-gcEepromAggregatePages;
+}
+
+/*
+ * the compact tiers share a quarter of the buffer, the rest holds raw pages.
+ * A tier needs at least the pages merged into one page of the next tier.
+ */
+static uint16_t TierRingPages()
+{
+  const uint16_t pages = EepromBufferPages()/4u/gcCompactTiers;
+  return (pages>gcTierFactor) ? pages : gcTierFactor;
+}
+
+static uint16_t RawRingPages()
+{
+  return EepromBufferPages()-gcCompactTiers*TierRingPages();
+}
+
+/*
+ * number of cycles covered by a record of a tier
+ */
+static uint8_t TierSpan(const uint8_t tier)
+{
+  uint8_t span = 1u;
+  for(uint8_t i=0u;i<tier;i++)
+  {
+    span *= gcTierFactor;
+  }
+  return span;
+}
 
-uint16_t  EepromGetMemAddr()
+uint32_t  EepromGetMemAddr()
 {
   return gEepromMemAddr;
 }
 
-uint16_t  EepromGetMemPageAddr()
+uint32_t  EepromGetMemPageAddr()
 {
   return (EepromGetMemAddr()-(EepromGetMemAddr()%gcEepromPageSize));
 }
 
+/*
+ * address of a completed raw page, 0 is the page written last
+ */
+static uint32_t RawPageAddr(const uint16_t page)
+{
+  uint32_t       addr          = (page+1ul)*gcEepromPageSize;
+  const uint32_t current_addr  = EepromGetMemPageAddr();
+  if(current_addr>=addr)
+    addr = current_addr-addr;
+  else
+    addr = (static_cast<uint32_t>(gcEepromPageSize)*RawRingPages())-(addr-current_addr);
+  return addr;
+}
+
+/*
+ * address of a page of a compact tier, 0 is the page written last
+ */
+static uint32_t TierPageAddr(const uint8_t tier,const uint16_t page)
+{
+  const uint16_t ringPages = TierRingPages();
+  const uint16_t first     = RawRingPages()+tier*ringPages;
+  return static_cast<uint32_t>(first+(gTiers[tier].head+ringPages-1u-page)%ringPages)*gcEepromPageSize;
+}
+
+/*
+ * address of a page not uploaded yet, 0 is the newest one. The raw pages come
+ * first, followed by the compact tiers in increasing age. Pages beyond the
+ * queue address the raw pages written before it.
+ */
+uint32_t EepromGetPageAddr(const uint16_t page)
+{
+  uint16_t raw = page;
+  if(page>=gRawPages)
+  {
+    uint16_t idx = page-gRawPages;
+    for(uint8_t tier=0u;tier<gcCompactTiers;tier++)
+    {
+      if(idx<gTiers[tier].pages)
+        return TierPageAddr(tier,idx);
+      idx -= gTiers[tier].pages;
+    }
+    raw = gRawPages+idx;
+  }
+  return RawPageAddr(raw%RawRingPages());
+}
+
+uint16_t EepromGetCycle()
+{
+  return gCycle;
+}
+
+static void TierWrite(const uint8_t tier,uint8_t page[])
+{
+  CompactTier &t = gTiers[tier];
+  if(EEPROM_I2C_write(static_cast<uint32_t>(RawRingPages()+tier*TierRingPages()+t.head)*gcEepromPageSize,page,gcEepromPageSize)==false)
+  {
+    SignalLED(LED_ERROR);
+  }
+  t.head = (t.head+1u)%TierRingPages();
+  t.pages++;
+}
+
+/*
+ * merge the oldest pages of a tier into one page of the next tier
+ */
+static void TierMerge(const uint8_t tier)
+{
+  uint8_t      page[gcEepromPageSize];
+  CompactTier &t = gTiers[tier];
+
+  CompactionBegin(TierSpan(tier+1u));
+  for(uint8_t i=0u;i<gcTierFactor;i++)
+  {
+    EEPROM_I2C_read(TierPageAddr(tier,t.pages-1u),page,sizeof(page));
+    CompactionAddPage(page,0u);
+    t.pages--;
+  }
+  CompactionEnd(page);
+  TierWrite(tier+1u,page);
+}
+
+/*
+ * move the oldest raw pages into tier 0. Full tiers pass their oldest pages
+ * on first, beginning with the oldest tier, so every tier has room for the
+ * page it receives.
+ */
+static void EepromBufferCompact()
+{
+  uint8_t page[gcEepromPageSize];
+  uint8_t tier = 0u;
+
+  while(tier<gcCompactTiers and gTiers[tier].pages>=TierRingPages())
+  {
+    tier++;
+  }
+  if(tier==gcCompactTiers)  // all tiers full, drop the oldest page
+  {
+    tier--;
+    gTiers[tier].pages--;
+  }
+  while(tier>0u)
+  {
+    tier--;
+    TierMerge(tier);
+  }
+
+  CompactionBegin(TierSpan(0u));
+  for(uint8_t i=0u;i<gcCompactRecords;i++)
+  {
+    EEPROM_I2C_read(RawPageAddr(gRawPages-1u),page,sizeof(page));
+    CompactionAddPage(page,gTailCycle);
+    gTailCycle++;
+    gRawPages--;
+  }
+  CompactionEnd(page);
+  TierWrite(0u,page);
+}
 
 static bool EepromBufferWrite(uint8_t data)
 {  
@@ -48,16 +237,18 @@ static bool EepromBufferWrite(uint8_t data)
   
   if(gEepromMemAddr%gcEepromPageSize==0)
   {
+    if(gEepromMemAddr >= static_cast<uint32_t>(gcEepromPageSize)*RawRingPages())  // overflow
+    {
+      gEepromMemAddr = 0u;
+    }
+
+    gCycle++;
     EepromNewPages(INCREASE);
   
-    if(EepromNewPages(GET) >= 452u)  // eeprom nearly full!
+    if(gRawPages+1u >= RawRingPages())  // the next page would overwrite the oldest raw page
     {
       SignalLED(LED_EEPROM);
-    }
-    
-    if(gEepromMemAddr >= gcEepromPages*gcEepromPageSize)  // overflow
-    {
-      gEepromMemAddr = 0u;
+      EepromBufferCompact();
     }
   }
   return res;
@@ -94,17 +285,29 @@ bool EepromBufferFlash()
   return EepromBufferWriteBits(0u,8u-gBitIdx);
 }
 
+/*
+ * number of pages not uploaded yet, raw and compact
+ */
 uint16_t EepromNewPages(NPMODE mode)
 {
-  static uint16_t         gNewMemPages    = 0u;
-  
-  if(mode==INCREASE and gNewMemPages<gcEepromPages)
+  if(mode==INCREASE and gRawPages<RawRingPages())
   {
-    gNewMemPages++;
+    gRawPages++;
   }
   else if(mode==RESET)
   {
-    gNewMemPages = 0;
+    gRawPages   = 0u;
+    gTailCycle  = gCycle;
+    for(uint8_t tier=0u;tier<gcCompactTiers;tier++)
+    {
+      gTiers[tier].pages = 0u;
+    }
+  }
+
+  uint16_t pages = gRawPages;
+  for(uint8_t tier=0u;tier<gcCompactTiers;tier++)
+  {
+    pages += gTiers[tier].pages;
   }
-  return gNewMemPages;
+  return pages;
 }
@@ -27,8 +27,11 @@
 enum NPMODE           {GET,INCREASE,RESET};
 
 uint16_t  EepromNewPages(NPMODE mode);
-uint16_t  EepromGetMemAddr();
-uint16_t  EepromGetMemPageAddr();
+uint16_t  EepromBufferPages();
+uint32_t  EepromGetMemAddr();
+uint32_t  EepromGetMemPageAddr();
+uint32_t  EepromGetPageAddr(const uint16_t page);
+uint16_t  EepromGetCycle();
 bool      EepromBufferWriteBits(const uint16_t data,const uint8_t bits);
 bool      EepromBufferFlash();
 
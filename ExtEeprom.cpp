@@ -19,35 +19,51 @@
 /////////////////////////////////////////////////////////////////////////////////////////
 #include "ExtEeprom.h"
 
+/*
+ * Every device address from 0x50 to 0x57 which acknowledges is used as one bank
+ * with 16 bit addressing. Devices larger than 64 KB (24xx1025, 24xxM02) map the
+ * upper address bits to the block select bits of the device address and thus
+ * show up as several banks. The banks are concatenated to one logical address
+ * space in the order of their device address.
+ */
+struct EepromBank
+{
+  uint8_t   i2cAddr;
+  uint8_t   chunkSize;  // bytes per write or read transfer, never crosses a physical page
+  uint32_t  size;
+};
+
 const uint8_t gcEepromI2CAddr = 0x50u;
+const uint8_t gcEepromMaxBanks = 8u;
 const uint8_t gcI2CTimeout = 100u;  // milli seconds
+const uint8_t gcWireChunkSize = 16u; // the Wire buffer takes 32 bytes including the address
 
-static bool    EEPROM_I2C_write128(uint16_t addr,uint8_t *data); 
-static uint8_t EEPROM_I2C_read128(uint16_t addr,uint8_t *data);
+static EepromBank gBanks[gcEepromMaxBanks] = {{gcEepromI2CAddr,gcWireChunkSize,32768ul}}; // 24LC256 until probed
+static uint8_t    gBankCount    = 1u;
+static uint16_t   gPhysPageSize = 64u;  // smallest page of all banks
 
-bool EEPROM_I2C_begin() 
+static bool     EEPROM_I2C_ready(uint8_t dev);
+static bool     EEPROM_I2C_waitReady(uint8_t dev);
+static uint8_t  EEPROM_I2C_bank(uint32_t &addr);
+static bool     EEPROM_I2C_writeDev(uint8_t dev,uint16_t addr,const uint8_t *data,uint8_t dataSize);
+static uint8_t  EEPROM_I2C_readDev(uint8_t dev,uint16_t addr,uint8_t *data,uint8_t dataSize);
+static bool     EEPROM_I2C_aliases(uint8_t dev,uint16_t offset);
+static uint32_t EEPROM_I2C_probeSize(uint8_t dev);
+static uint16_t EEPROM_I2C_probePageSize(uint8_t dev);
+
+static bool EEPROM_I2C_ready(uint8_t dev)
 {
-  Wire.beginTransmission(gcEepromI2CAddr);
-  if (Wire.endTransmission() == 0) 
-  {
-    return true;
-  }
-  return false;
+  Wire.beginTransmission(dev);
+  return (Wire.endTransmission() == 0);
 }
 
-bool EEPROM_I2C_write8(uint16_t addr, uint8_t value) 
-{ 
-  Wire.beginTransmission(gcEepromI2CAddr);
-  Wire.write(addr >> 8);
-  Wire.write(addr & 0xFF);
-  Wire.write(value);
-  Wire.endTransmission();
-
+// Wait until it acks!
+static bool EEPROM_I2C_waitReady(uint8_t dev)
+{
   const unsigned long timeOut = millis()+gcI2CTimeout;
   while (millis()<timeOut) 
   {
-    Wire.beginTransmission(gcEepromI2CAddr);
-    if (Wire.endTransmission() == 0) 
+    if (EEPROM_I2C_ready(dev)) 
     {
       return true;
     }
@@ -56,90 +72,240 @@ bool EEPROM_I2C_write8(uint16_t addr, uint8_t value)
   return false;
 }
 
-uint8_t EEPROM_I2C_read8(uint16_t addr) 
+/*
+ * returns the bank of a logical address and converts addr to the offset within this bank
+ */
+static uint8_t EEPROM_I2C_bank(uint32_t &addr)
 {
-  Wire.beginTransmission(gcEepromI2CAddr);
-  Wire.write(addr >> 8);
-  Wire.write(addr & 0xFF);
-  Wire.endTransmission();
-
-  if (1 != Wire.requestFrom(gcEepromI2CAddr, (uint8_t)1)) 
+  uint8_t bank = 0u;
+  while(bank+1u<gBankCount and addr>=gBanks[bank].size)
   {
-    return 0;
+    addr -= gBanks[bank].size;
+    bank++;
   }
-  return Wire.read();
+  return bank;
 }
 
-bool EEPROM_I2C_write128(uint16_t addr,uint8_t *data) 
+static bool EEPROM_I2C_writeDev(uint8_t dev,uint16_t addr,const uint8_t *data,uint8_t dataSize)
 {
-  const uint8_t dataSize=16;
-  Wire.beginTransmission(gcEepromI2CAddr);
+  Wire.beginTransmission(dev);
   Wire.write(addr >> 8);
   Wire.write(addr & 0xFF);
   Wire.write(data,dataSize);
   Wire.endTransmission();
+  return EEPROM_I2C_waitReady(dev);
+}
 
-  // Wait until it acks!
+static uint8_t EEPROM_I2C_readDev(uint8_t dev,uint16_t addr,uint8_t *data,uint8_t dataSize)
+{
+  Wire.beginTransmission(dev);
+  Wire.write(addr >> 8);
+  Wire.write(addr & 0xFF);
+  Wire.endTransmission();
+  Wire.requestFrom(dev, dataSize);
+  uint8_t i = 0;
   const unsigned long timeOut = millis()+gcI2CTimeout;
-  while (millis()<timeOut)
+  while (millis()<timeOut and i<dataSize)
   {
-    Wire.beginTransmission(gcEepromI2CAddr);
-    if (Wire.endTransmission() == 0) 
+    if(Wire.available())
     {
-      return true;
+      data[i]= Wire.read();    // receive a byte as character
+      i++;
     }
-    delay(1);
   }
-  return false;
+  return i;
 }
 
-bool EEPROM_I2C_write(uint16_t addr,uint8_t data[],uint8_t dataSize) 
+/*
+ * The probes only write the last byte of a device, 16 bit address 0xFFFF
+ * reaches it whatever the size, and the start of its last physical page.
+ * On the last bank these bytes belong to the aggregate pages, on the others to
+ * the ring buffer. Every byte written is restored.
+ */
+const uint16_t gcEepromProbeAddr = 0xFFFFu;
+
+/*
+ * true if the device ignores the address bits from offset on, i.e. the probe
+ * address minus offset maps to the probe address
+ */
+static bool EEPROM_I2C_aliases(uint8_t dev,uint16_t offset)
 {
-  int i;
-  for(i=0;i<(dataSize-15);i+=16,addr+=16)
+  uint8_t value = 0u;
+  uint8_t other = 0u;
+  EEPROM_I2C_readDev(dev,gcEepromProbeAddr,&value,1u);
+  EEPROM_I2C_readDev(dev,gcEepromProbeAddr-offset,&other,1u);
+  if(value != other)
   {
-    EEPROM_I2C_write128(addr,data+i);
+    return false;
   }
-  for(;i<dataSize;i++,addr++)
+
+  uint8_t test = value ^ 0xFFu;
+  EEPROM_I2C_writeDev(dev,gcEepromProbeAddr,&test,1u);
+  EEPROM_I2C_readDev(dev,gcEepromProbeAddr-offset,&other,1u);
+  EEPROM_I2C_writeDev(dev,gcEepromProbeAddr,&value,1u);
+  return (other == test);
+}
+
+static uint32_t EEPROM_I2C_probeSize(uint8_t dev)
+{
+  for(uint32_t size=4096ul;size<65536ul;size<<=1u)
   {
-    EEPROM_I2C_write8(addr,data[i]);
+    if(EEPROM_I2C_aliases(dev,size))
+    {
+      return size;
+    }
   }
-  return i;
+  return 65536ul;
 }
 
-
-uint8_t EEPROM_I2C_read128(uint16_t addr,uint8_t *data)
+/*
+ * a write wraps around at the end of a physical page. Write two bytes from the
+ * last byte of the device on and look at which candidate page start the second
+ * one ended up. It is made to differ from all of them before.
+ */
+static uint16_t EEPROM_I2C_probePageSize(uint8_t dev)
 {
-  const uint8_t dataSize=16;
-  Wire.beginTransmission(gcEepromI2CAddr);
-  Wire.write(addr >> 8);
-  Wire.write(addr & 0xFF);
-  Wire.endTransmission();
-  Wire.requestFrom(gcEepromI2CAddr, dataSize);
-  uint8_t i = 0;
-  const unsigned long timeOut = millis()+gcI2CTimeout;
-  while (millis()<timeOut and i<dataSize)
+  const uint8_t gcCandidates = 6u;  // page sizes 8 to 256
+  uint8_t saved[gcCandidates];
+  uint8_t last;
+  EEPROM_I2C_readDev(dev,gcEepromProbeAddr,&last,1u);
+  for(uint8_t i=0u;i<gcCandidates;i++)
   {
-    if(Wire.available())
+    EEPROM_I2C_readDev(dev,gcEepromProbeAddr-((8u<<i)-1u),&(saved[i]),1u);
+  }
+
+  uint8_t test[2] = {static_cast<uint8_t>(last^0xFFu),0u};
+  uint8_t i = 0u;
+  while(i<gcCandidates)
+  {
+    if(saved[i]==test[1])
+    {
+      test[1]++;
+      i = 0u;
+    }
+    else
     {
-      data[i]= Wire.read();    // receive a byte as character
       i++;
     }
   }
-  return i;
+  EEPROM_I2C_writeDev(dev,gcEepromProbeAddr,test,2u);
+
+  uint16_t size = 256u;
+  for(i=0u;i<gcCandidates;i++)
+  {
+    const uint16_t start = gcEepromProbeAddr-((8u<<i)-1u);
+    uint8_t check;
+    EEPROM_I2C_readDev(dev,start,&check,1u);
+    if(check==test[1])
+    {
+      size = 8u<<i;
+      EEPROM_I2C_writeDev(dev,start,&(saved[i]),1u);
+      break;
+    }
+  }
+  EEPROM_I2C_writeDev(dev,gcEepromProbeAddr,&last,1u);
+  return size;
 }
 
-uint8_t EEPROM_I2C_read(uint16_t addr,uint8_t data[],uint8_t dataSize) 
+/*
+ * detect the connected devices, their capacity and page size. Every bank is
+ * probed on its own, a mix of devices gets the chunk size of each one.
+ */
+bool EEPROM_I2C_begin() 
 {
-  int i;
-  for(i=0;i<(dataSize-15);i+=16,addr+=16)
+  gBankCount    = 0u;
+  gPhysPageSize = 256u;
+  for(uint8_t dev=gcEepromI2CAddr;dev<gcEepromI2CAddr+gcEepromMaxBanks;dev++)
   {
-    EEPROM_I2C_read128(addr,data+i);
+    if(EEPROM_I2C_ready(dev))
+    {
+      EepromBank &bank        = gBanks[gBankCount];
+      bank.i2cAddr            = dev;
+      bank.size               = EEPROM_I2C_probeSize(dev);
+      const uint16_t pageSize = EEPROM_I2C_probePageSize(dev);
+      if(pageSize<gPhysPageSize)
+      {
+        gPhysPageSize         = pageSize;
+      }
+      bank.chunkSize          = (pageSize<gcWireChunkSize) ? pageSize : gcWireChunkSize;
+      gBankCount++;
+    }
   }
-  for(;i<dataSize;i++,addr++)
+  return (gBankCount>0u);
+}
+
+uint32_t EEPROM_I2C_capacity()
+{
+  uint32_t capacity = 0ul;
+  for(uint8_t bank=0u;bank<gBankCount;bank++)
   {
-    data[i] = EEPROM_I2C_read8(addr);
+    capacity += gBanks[bank].size;
   }
-  return i;
+  return capacity;
 }
 
+uint16_t EEPROM_I2C_pages()
+{
+  return EEPROM_I2C_capacity()/gcEepromPageSize;
+}
+
+uint16_t EEPROM_I2C_physPageSize()
+{
+  return gPhysPageSize;
+}
+
+bool EEPROM_I2C_write8(uint32_t addr, uint8_t value) 
+{ 
+  const uint8_t bank = EEPROM_I2C_bank(addr);
+  return EEPROM_I2C_writeDev(gBanks[bank].i2cAddr,addr,&value,1u);
+}
+
+uint8_t EEPROM_I2C_read8(uint32_t addr) 
+{
+  uint8_t value = 0u;
+  const uint8_t bank = EEPROM_I2C_bank(addr);
+  EEPROM_I2C_readDev(gBanks[bank].i2cAddr,addr,&value,1u);
+  return value;
+}
+
+/*
+ * the data is split into chunks that end at a chunk boundary, so a transfer
+ * never crosses a physical page or a bank.
+ */
+bool EEPROM_I2C_write(uint32_t addr,uint8_t data[],uint8_t dataSize) 
+{
+  bool res  = true;
+  uint8_t i = 0u;
+  while(i<dataSize)
+  {
+    uint32_t      offset    = addr+i;
+    const uint8_t bank      = EEPROM_I2C_bank(offset);
+    const uint8_t chunkSize = gBanks[bank].chunkSize;
+    uint8_t       n         = chunkSize-(offset%chunkSize);
+    if(n>dataSize-i)
+      n = dataSize-i;
+    if(!EEPROM_I2C_writeDev(gBanks[bank].i2cAddr,offset,data+i,n))
+      res = false;
+    i += n;
+  }
+  return res;
+}
+
+uint8_t EEPROM_I2C_read(uint32_t addr,uint8_t data[],uint8_t dataSize) 
+{
+  uint8_t i = 0u;
+  while(i<dataSize)
+  {
+    uint32_t      offset    = addr+i;
+    const uint8_t bank      = EEPROM_I2C_bank(offset);
+    const uint8_t chunkSize = gBanks[bank].chunkSize;
+    uint8_t       n         = chunkSize-(offset%chunkSize);
+    if(n>dataSize-i)
+      n = dataSize-i;
+    const uint8_t r = EEPROM_I2C_readDev(gBanks[bank].i2cAddr,offset,data+i,n);
+    i += r;
+    if(r<n)
+      break;
+  }
+  return i;
+}
@@ -24,14 +24,16 @@
 #include "Arduino.h"
 #include "Global.h"
 
-const uint16_t gcEepromPages = 512u;
-const uint16_t gcEepromPageSize = 64u;
+const uint16_t gcEepromPageSize = 64u;      // logical page, holds one cycle of the bit stream
+const uint16_t gcEepromAggregatePages = 2u; // the last pages hold the hourly and daily aggregates
 
-bool    EEPROM_I2C_begin();
-bool    EEPROM_I2C_write8(uint16_t addr, uint8_t value);
-uint8_t EEPROM_I2C_read8(uint16_t addr);
-bool    EEPROM_I2C_write(uint16_t addr,uint8_t data[],uint8_t dataSize);
-uint8_t EEPROM_I2C_read( uint16_t addr,uint8_t data[],uint8_t dataSize);
+bool     EEPROM_I2C_begin();
+uint32_t EEPROM_I2C_capacity();
+uint16_t EEPROM_I2C_pages();
+uint16_t EEPROM_I2C_physPageSize();
+bool     EEPROM_I2C_write8(uint32_t addr, uint8_t value);
+uint8_t  EEPROM_I2C_read8(uint32_t addr);
+bool     EEPROM_I2C_write(uint32_t addr,uint8_t data[],uint8_t dataSize);
+uint8_t  EEPROM_I2C_read( uint32_t addr,uint8_t data[],uint8_t dataSize);
 
 #endif // EEPROM_H
-
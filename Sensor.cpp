@@ -28,9 +28,6 @@ static uint16_t gLum  = 0u;
 static LIGHT_PRESCALER gLumPresacler = PRESCALER_OFF;
 
 static uint16_t         ReadAnalog(const int pin);
-static void MeasureLight();
-static void MeasureTemperature();
-static void MeasureUsol();
 
 void InitAnalogeSensors()
 {
@@ -97,7 +94,7 @@ void MeasureSensors()
   MeasureLight();
 }
 
-static void MeasureLight()
+void MeasureLight()
 {
   gLumPresacler = PRESCALER_OFF;
   gLum = ReadAnalog(PIN_LIGHT);
@@ -110,7 +107,7 @@ static void MeasureLight()
   }
 }
 
-static void MeasureUsol()
+void MeasureUsol()
 {
   gUsol = ReadAnalog(PIN_U_SOL);
 }
@@ -120,7 +117,7 @@ void MeasureUBat()
   gUbat = ReadAnalog(PIN_U_BAT);
 }
 
-static void MeasureTemperature()
+void MeasureTemperature()
 {
   gTemp = ReadAnalog(PIN_T_MEAS);
 }
@@ -29,6 +29,9 @@ void InitAnalogeSensors();
 
 void MeasureSensors();
 void MeasureUBat();
+void MeasureUsol();
+void MeasureLight();
+void MeasureTemperature();
 
 uint16_t GetTemperature();
 uint16_t GetRawUbat();
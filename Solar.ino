@@ -23,6 +23,7 @@
 
 #include "ExtEeprom.h"
 #include "EepromBuffer.h"
+#include "Aggregate.h"
 #include "BME280.h"
 #include "Sensor.h"
 #include "Global.h"
@@ -34,16 +35,23 @@
 #define BAT_RECHARGE_HIGH_VOLTAGE   2.092f
 #define SOL_LOW_LIGHT_VOLTAGE       3.0f
 #define SOL_NO_LIGHT_VOLTAGE        1.0f
+#define WAKE_INTERVAL               8u    // seconds, matches SLEEP_8S
+#define WAKE_DIM_TICKS              5u    // max. watchdog periods per wake at low light
+#define WAKE_IDLE_TICKS             10u   // max. watchdog periods per wake in the dark or at low charge
+#define WAKE_LOW_CHARGE_LEVEL       0.25f
 
 enum PWR_EVENT        {BAT_NORMAL,BAT_CHARGEING,BAT_FULL,BAT_OVER_VOLTAGE};
+enum STREAM_CHANNEL   {STREAM_USOL,STREAM_UBAT,STREAM_TEMP,STREAM_LIGHT,STREAM_PRESSURE,STREAM_HUMIDITY,STREAM_HOUSING_TEMP,STREAM_CHANNELS};
 enum CMOS_STATE       {M_OFF,M_ON};
 
 static bool     gOverVoltageFlag    = false;
 static bool     gHangUpFlag         = false;
 static bool     gForceUpload        = false;
+static volatile bool gSwitchWake    = false;  // set by a switch, ends a chained sleep
 
 static PWR_EVENT        gPowerStatus    = BAT_NORMAL;
 static uint8_t          gWlanErr        = 0u;
+static uint8_t          gCallCount      = 0u;   // position in the current cycle, one per watchdog period
 
 // ############################################################################################################################
 // ##### function declaration #####
@@ -56,10 +64,11 @@ static void             SetSState(const CMOS_STATE state);
 static float            ChargeLevel(const float Ubat);
 static void             BatManagement();
 static void             PowerManagement();
+static uint8_t          WakeTicks();
 
 // memory
-static void             WhatNeedsToBeWritten(bool &bWriteLight, bool &bWritePresureAndUsol, bool &bWriteTemperature, bool &bWriteOther, bool &bWriteAlignBits);
-static void             WriteEeprom();
+static void             WhatNeedsToBeWritten(const uint8_t ticks, bool &bWriteLight, bool &bWritePresureAndUsol, bool &bWriteTemperature, bool &bWriteOther, bool &bWriteAlignBits);
+static void             WriteEeprom(const uint8_t ticks);
 static void             WriteLight();
 static void             WritePresureAndUsol();
 static void             WriteTemperature();
@@ -73,6 +82,9 @@ static uint16_t         CRC16 (const unsigned char bits[],const int n);
 static void             SerialFlushInput();
 static void             PrintRawValues();
 static void             TransmitBlock(const uint16_t page,bool verbose_mode=false);
+static void             TransmitSummary();
+static uint16_t         StreamValue(const STREAM_CHANNEL channel,const float pressure,const float humidity,const float temperature);
+static void             StreamTelemetry(const uint32_t interval,const uint8_t mask);
 static char *           ReadFromSerial();
 static void             EnterDebugMode();
 static bool             EnterUploadMode();
@@ -219,11 +231,41 @@ static void PowerManagement()
   }
 }
 
+/*
+ * number of watchdog periods to sleep until the next wake. While charging or
+ * in bright light the station wakes every period, the charge estimation of
+ * BatManagement() relies on that. In the dark or at low charge the sleeps are
+ * chained, but a wake always falls on the next period that writes a record.
+ */
+static uint8_t WakeTicks()
+{
+  const float Usol  = GetUsol();
+  uint8_t     ticks = 1u;
+  if(gPowerStatus == BAT_CHARGEING)
+  {
+    ticks = 1u;
+  }
+  else if(Usol<SOL_NO_LIGHT_VOLTAGE or ChargeLevel(GetUbat())<WAKE_LOW_CHARGE_LEVEL)
+  {
+    ticks = WAKE_IDLE_TICKS;
+  }
+  else if(Usol<SOL_LOW_LIGHT_VOLTAGE)
+  {
+    ticks = WAKE_DIM_TICKS;
+  }
+
+  const uint8_t nextRecord = 10u-gCallCount%10u;
+  if(ticks>nextRecord)
+    ticks = nextRecord;
+  return ticks;
+}
+
 // ##### implementation of memory functions #####
 static void WriteLight()
 {
   EepromBufferWriteBits(GetRawLum()         ,10u);
   EepromBufferWriteBits(GetRawLumPresacler(),2u);
+  AggregateAddSample(GetRawLumPresacler()==PRESCALER_OFF ? AGG_LIGHT : AGG_LIGHT_PRESCALED,GetRawLum());
 }
 
 static void WritePresureAndUsol()
@@ -232,11 +274,14 @@ static void WritePresureAndUsol()
 
   EepromBufferWriteBits(GetRawUsol()    ,10u);
   EepromBufferWriteBits(GetRawPressure(),10u);
+  AggregateAddSample(AGG_USOL    ,GetRawUsol());
+  AggregateAddSample(AGG_PRESSURE,GetRawPressure());
 }
 
 static void WriteTemperature()
 {
   EepromBufferWriteBits(GetRawTemp(),10u);
+  AggregateAddSample(AGG_TEMPERATURE,GetRawTemp());
 }
 
 static void WriteOther()
@@ -246,37 +291,43 @@ static void WriteOther()
   EepromBufferWriteBits(GetRawHousingTemperature(),8u);
   EepromBufferWriteBits(gPowerStatus              ,2u);
   EepromBufferWriteBits(GetRawUbat()              ,10u);
+  AggregateAddSample(AGG_HUMIDITY,GetRawHumidity());
+  AggregateAddSample(AGG_UBAT    ,GetRawUbat());
 }
 
-static void WhatNeedsToBeWritten(bool &bWriteLight, bool &bWritePresureAndUsol, bool &bWriteTemperature, bool &bWriteOther,bool &bWriteAlignBits)
+/*
+ * ticks is the number of watchdog periods since the last call. WakeTicks()
+ * never skips a period that writes a record, so every record keeps its
+ * position in the cycle and its time can be derived from it.
+ */
+static void WhatNeedsToBeWritten(const uint8_t ticks, bool &bWriteLight, bool &bWritePresureAndUsol, bool &bWriteTemperature, bool &bWriteOther,bool &bWriteAlignBits)
 {
-  static uint8_t callCount = 1u;
-  if(callCount==201)
+  gCallCount += ticks;
+  if(gCallCount>200u)
   {
-    callCount=1u;
+    gCallCount-=200u;
     bWriteAlignBits = true;
   }
   
-  if(callCount%10u == 0)
+  if(gCallCount%10u == 0)
   {
     bWriteLight=true;
-    if(callCount%20u == 0)
+    if(gCallCount%20u == 0)
     {
       bWritePresureAndUsol=true;
     }
-    if(callCount%50u == 0)
+    if(gCallCount%50u == 0)
     {
       bWriteTemperature=true;
-      if(callCount == 200)
+      if(gCallCount == 200)
       {
         bWriteOther = true;
       }
     }
   }
-  callCount++;
 }
 
-static void WriteEeprom()
+static void WriteEeprom(const uint8_t ticks)
 {
   bool bWriteLight          = false;
   bool bWritePresureAndUsol = false;
@@ -284,7 +335,7 @@ static void WriteEeprom()
   bool bWriteOther          = false;
   bool bWriteAlignBits      = false;
 
-  WhatNeedsToBeWritten(bWriteLight,bWritePresureAndUsol,bWriteTemperature,bWriteOther,bWriteAlignBits);
+  WhatNeedsToBeWritten(ticks,bWriteLight,bWritePresureAndUsol,bWriteTemperature,bWriteOther,bWriteAlignBits);
 
   if(bWriteAlignBits)
   {
@@ -365,17 +416,14 @@ static void TransmitBlock(const uint16_t page,bool verbose_mode)
   const uint8_t pageByteSize  = 2u;
   uint8_t blkData[gcEepromPageSize+pageByteSize+crcByteSize];
   uint16_t      varSize       = 0;
-  uint16_t       addr          = (page+1u)*gcEepromPageSize;
-  const uint16_t current_addr = EepromGetMemPageAddr();
-  if(current_addr>=addr)
-    addr = current_addr-addr;
-  else
-    addr = (gcEepromPageSize*gcEepromPages)-(addr-current_addr);
+  const uint32_t addr         = EepromGetPageAddr(page);
+  // pages are aligned to 64 bytes, the unused low bits carry the address bits above 16
+  const uint16_t addrField    = (addr & 0xFFC0u) | ((addr >> 16u) & 0x3Fu);
   
   varSize = gcEepromPageSize;
   EEPROM_I2C_read(addr,blkData,varSize); // read page from eeprom
 
-  memcpy(&(blkData[varSize]),&addr,pageByteSize); // append eeprom address
+  memcpy(&(blkData[varSize]),&addrField,pageByteSize); // append eeprom address
 
   varSize = gcEepromPageSize+pageByteSize;          // append crc sum
   const uint16_t crcSum = CRC16(blkData,varSize);
@@ -403,6 +451,112 @@ static void TransmitBlock(const uint16_t page,bool verbose_mode)
   }
 }
 
+/*
+ * send the completed and the running hourly and daily aggregates followed by
+ * their crc sum
+ */
+static void TransmitSummary()
+{
+  const uint8_t crcByteSize   = 2u;
+  uint8_t sumData[2u*AGG_PERIODS*gcAggregateRecordSize+crcByteSize];
+
+  const uint8_t varSize = AggregateRead(sumData,2u*AGG_PERIODS*gcAggregateRecordSize);
+  const uint16_t crcSum = CRC16(sumData,varSize);
+  memcpy(&(sumData[varSize]),&crcSum,crcByteSize);
+
+  Serial.write(sumData,varSize+crcByteSize);
+}
+
+static uint16_t StreamValue(const STREAM_CHANNEL channel,const float pressure,const float humidity,const float temperature)
+{
+  switch(channel)
+  {
+    case STREAM_USOL:         return GetRawUsol();
+    case STREAM_UBAT:         return GetRawUbat();
+    case STREAM_TEMP:         return GetRawTemp();
+    case STREAM_LIGHT:        return (static_cast<uint16_t>(GetRawLumPresacler())<<10u)|GetRawLum();
+    case STREAM_PRESSURE:     return pressure*10.0f;              // 0.1 hPa
+    case STREAM_HUMIDITY:     return humidity*10.0f;              // 0.1 %
+    case STREAM_HOUSING_TEMP: return (temperature+40.0f)*10.0f;  // 0.1 K above -40 C
+    default:                  return 0u;
+  }
+}
+
+/*
+ * send a binary frame with the selected channels every interval milli seconds
+ * until any byte is received:
+ *   0xA5 0x5A, sequence number (uint16_t), time in ms (uint16_t), channel mask (uint8_t),
+ *   one uint16_t per channel set in the mask, crc16 over all bytes after the sync bytes
+ */
+static void StreamTelemetry(const uint32_t interval,const uint8_t mask)
+{
+  const uint8_t syncByteSize  = 2u;
+  const uint8_t crcByteSize   = 2u;
+  uint8_t       frame[syncByteSize+2u+2u+1u+STREAM_CHANNELS*2u+crcByteSize];
+  uint16_t      seq           = 0u;
+  unsigned long nextTime      = millis();
+
+  frame[0] = 0xA5u;
+  frame[1] = 0x5Au;
+  SerialFlushInput();
+  while(Serial.available()==0 and digitalRead(PIN_SW_1)==LOW)
+  {
+    while(static_cast<long>(millis()-nextTime)<0)
+    {
+      if(Serial.available()>0)
+        break;
+    }
+    if(Serial.available()>0)  // stop byte arrived during the wait
+      break;
+    nextTime += interval;
+
+    const uint16_t now  = millis();
+    float pressure      = 0.0f;
+    float humidity      = 0.0f;
+    float temperature   = 0.0f;
+    if(mask & (1u<<STREAM_USOL))
+      MeasureUsol();
+    if(mask & (1u<<STREAM_UBAT))
+      MeasureUBat();
+    if(mask & (1u<<STREAM_TEMP))
+      MeasureTemperature();
+    if(mask & (1u<<STREAM_LIGHT))
+      MeasureLight();
+    if(mask & ((1u<<STREAM_PRESSURE)|(1u<<STREAM_HUMIDITY)|(1u<<STREAM_HOUSING_TEMP)))
+    {
+      pressure    = BME280_readTempAndPressure();
+      humidity    = BME280_readHumidity();
+      temperature = BME280_readTempC();
+    }
+
+    uint8_t varSize = syncByteSize;
+    memcpy(&(frame[varSize]),&seq,2u);
+    varSize += 2u;
+    memcpy(&(frame[varSize]),&now,2u);
+    varSize += 2u;
+    frame[varSize] = mask;
+    varSize++;
+    for(uint8_t ch=0u;ch<STREAM_CHANNELS;ch++)
+    {
+      if(mask & (1u<<ch))
+      {
+        const uint16_t value = StreamValue(static_cast<STREAM_CHANNEL>(ch),pressure,humidity,temperature);
+        memcpy(&(frame[varSize]),&value,2u);
+        varSize += 2u;
+      }
+    }
+    const uint16_t crcSum = CRC16(&(frame[syncByteSize]),varSize-syncByteSize);
+    memcpy(&(frame[varSize]),&crcSum,crcByteSize);
+    varSize += crcByteSize;
+
+    Serial.write(frame,varSize);
+    seq++;
+  }
+  Serial.flush();
+  delay(10);
+  SerialFlushInput();
+}
+
 static char * ReadFromSerial()
 {
   static char msg[16];
@@ -422,7 +576,7 @@ static char * ReadFromSerial()
 
 static void EnterDebugMode()
 {
-  static int eepromWritePointer = 0;
+  static uint32_t eepromWritePointer = 0;
   bool runLoop = true;
   while(runLoop)
   {
@@ -462,11 +616,20 @@ static void EnterDebugMode()
         else if(strncmp(msg,"GET",3)==0)
         {
           int pageNr = atoi(&(msg[3]));
-          if(pageNr >= 0 and (uint16_t)pageNr < gcEepromPages)
+          if(pageNr >= 0 and (uint16_t)pageNr < EepromBufferPages())
           {
             TransmitBlock(pageNr,true);
           }
         }
+        else if(strncmp(msg,"SUM",3)==0)
+        {
+          TransmitSummary();
+          Serial.println("");
+        }
+        else if(strncmp(msg,"CYC",3)==0)
+        {
+          Serial.println(EepromGetCycle());
+        }
         else if(strncmp(msg,"VAL",3)==0)
         {
           MeasureSensors();
@@ -474,7 +637,7 @@ static void EnterDebugMode()
         }
         else if(strncmp(msg,"REP",3)==0)
         {
-          int addr = atoi(&(msg[3]));
+          uint32_t addr = atol(&(msg[3]));
           uint8_t data = EEPROM_I2C_read8(addr);
           Serial.println(data,HEX);
         }
@@ -488,9 +651,16 @@ static void EnterDebugMode()
         }
         else if(strncmp(msg,"SEP",3)==0)
         {
-          eepromWritePointer = atoi(&(msg[3]));
+          eepromWritePointer = atol(&(msg[3]));
           Serial.println("eepromWritePointer");
         }
+        else if(strncmp(msg,"CAP",3)==0)
+        {
+          Serial.print("capacity ");
+          Serial.print(EEPROM_I2C_capacity());
+          Serial.print(" page size ");
+          Serial.println(EEPROM_I2C_physPageSize());
+        }
         else if(strncmp(msg,"WPG",3)==0)
         {
           Serial.println("write eeprom page not implemented");
@@ -520,6 +690,17 @@ static void EnterDebugMode()
           }
           Serial.println();
         }
+        else if(strncmp(msg,"STR",3)==0)   // STR<interval ms>,<channel mask>
+        {
+          uint32_t interval = strtoul(&(msg[3]),NULL,10);
+          uint8_t  mask     = (1u<<STREAM_CHANNELS)-1u;
+          const char *sep   = strchr(msg,',');
+          if(sep != NULL)
+            mask = atoi(sep+1) & mask;
+          if(interval==0u)
+            interval = 200u;
+          StreamTelemetry(interval,mask);
+        }
         else if(strncmp(msg,"BME",3)==0)
         {
           BME280_Measure();
@@ -553,7 +734,9 @@ static void DataUpload()
       GetUsol()>SOL_LOW_LIGHT_VOLTAGE ) or 
       (gForceUpload and EepromNewPages(GET)>0))
   {
+    const uint32_t start = millis();
     EnterUploadMode();
+    AggregateTick((millis()-start)/1000ul);
   }
 }
 
@@ -612,11 +795,19 @@ static bool EnterUploadMode()
         else if(strncmp(msg,"GET",3)==0)
         {
           int pageNr = atoi(&(msg[3]));
-          if(pageNr >= 0 and (uint16_t)pageNr < gcEepromPages)
+          if(pageNr >= 0 and (uint16_t)pageNr < EepromBufferPages())
           {
             TransmitBlock(pageNr);
           }
         }
+        else if(strncmp(msg,"SUM",3)==0)
+        {
+          TransmitSummary();
+        }
+        else if(strncmp(msg,"CYC",3)==0)
+        {
+          Serial.println(EepromGetCycle());
+        }
         else if(strncmp(msg,"END",3)==0)
         {
           EepromNewPages(RESET);
@@ -649,7 +840,9 @@ static void CheckSwitches()
     digitalWrite(PIN_UART_EN,HIGH);
     Serial.begin(19200);
     Serial.println("enter debug mode");
+    const uint32_t start = millis();
     EnterDebugMode();
+    AggregateTick((millis()-start)/1000ul);
     Serial.flush();
     Serial.end();
     digitalWrite(PIN_UART_EN,LOW);
@@ -694,6 +887,10 @@ void setup()
 
   pinMode(PIN_SW_1,INPUT_PULLUP);
   pinMode(PIN_SW_2,INPUT_PULLUP);
+  // PIN_SW_1 and PIN_SW_2 are PB1 and PB2, a pin change wakes from power down
+  PCMSK0 |= bit(PCINT1) | bit(PCINT2);
+  PCIFR  |= bit(PCIF0);
+  PCICR  |= bit(PCIE0);
   
   analogReference(EXTERNAL);
   
@@ -718,10 +915,25 @@ void setup()
   }
 }
 
+ISR(PCINT0_vect)
+{
+  gSwitchWake = true;
+}
+
 // the loop function
 void loop() 
 {
-  LowPower.powerDown(SLEEP_8S, ADC_OFF, BOD_OFF);
+  static uint8_t ticks = 1u;
+  uint8_t        slept = 0u;
+  // a switch ends a chained sleep early, the interrupted watchdog period counts
+  // as slept so a wake never repeats a position in the cycle
+  do
+  {
+    LowPower.powerDown(SLEEP_8S, ADC_OFF, BOD_OFF);
+    slept++;
+  } while(slept<ticks and !gSwitchWake);
+  gSwitchWake = false;
+
   if(gHangUpFlag)
   {
     SignalLED(LED_ERROR);
@@ -729,11 +941,13 @@ void loop()
   else
   {
     MeasureSensors();
-    WriteEeprom();
+    WriteEeprom(slept);
+    AggregateTick(slept*WAKE_INTERVAL);
     PowerManagement();
     CheckSwitches();
     if(gPowerStatus == BAT_CHARGEING)
       SignalLED(LED_CHARGE_BLINK);
     DataUpload();
+    ticks = WakeTicks();
   }
 }
@@ -0,0 +1,208 @@
+/////////////////////////////////////////////////////////////////////////////////////////
+//    This file is part of Solar.
+//
+//    Copyright (C) 2021 Matthias Hund
+//    
+//    This program is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU General Public License
+//    as published by the Free Software Foundation; either version 2
+//    of the License, or (at your option) any later version.
+//    
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//    
+//    You should have received a copy of the GNU General Public License
+//    along with this program; if not, write to the Free Software
+//    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+/////////////////////////////////////////////////////////////////////////////////////////
+#include "Frame.h"
+
+#include <cstring>
+
+class BitReader
+{
+public:
+  explicit BitReader(const uint8_t data[]) : mData(data), mIdx(0u) {}
+
+  uint16_t Read(unsigned bits)
+  {
+    uint16_t value = 0u;
+    for(unsigned i=0u;i<bits;i++,mIdx++)
+    {
+      value = (value<<1u) | ((mData[mIdx/8u] >> (7u-mIdx%8u)) & 1u);
+    }
+    return value;
+  }
+
+private:
+  const uint8_t *mData;
+  unsigned       mIdx;
+};
+
+static uint16_t gCrcTable[256];
+
+static bool InitCrcTable()
+{
+  for(unsigned i=0u;i<256u;i++)
+  {
+    uint16_t crc = i<<8u;
+    for(unsigned j=0u;j<8u;j++)
+    {
+      crc = (crc & 0x8000u) ? static_cast<uint16_t>((crc<<1u)^0x1021u) : static_cast<uint16_t>(crc<<1u);
+    }
+    gCrcTable[i] = crc;
+  }
+  return true;
+}
+
+static const bool gCrcTableReady = InitCrcTable();
+
+static void AppendUInt(std::string &out,unsigned value)
+{
+  char buf[12];
+  char *p = buf+sizeof(buf);
+  do
+  {
+    *--p = '0'+value%10u;
+    value /= 10u;
+  } while(value!=0u);
+  out.append(p,buf+sizeof(buf)-p);
+}
+
+static void AppendField(std::string &out,unsigned value)
+{
+  out += ',';
+  AppendUInt(out,value);
+}
+
+/*
+ * same result as the bitwise CRC16() of the firmware (CCITT, start value 0xFFFF)
+ */
+uint16_t Crc16(const uint8_t data[],size_t n)
+{
+  uint16_t crc = 0xFFFFu;
+  for(size_t i=0u;i<n;i++)
+  {
+    crc = static_cast<uint16_t>(crc<<8u) ^ gCrcTable[((crc>>8u) ^ data[i]) & 0xFFu];
+  }
+  return crc;
+}
+
+uint16_t FrameCrc(const uint8_t frame[])
+{
+  return frame[gcPageSize+gcAddrSize] | (frame[gcPageSize+gcAddrSize+1u]<<8u);
+}
+
+bool FrameCrcValid(const uint8_t frame[])
+{
+  return Crc16(frame,gcPageSize+gcAddrSize) == FrameCrc(frame);
+}
+
+/*
+ * the low 6 bits of the 64 byte aligned address carry the address bits above 16
+ */
+uint32_t FrameAddr(const uint8_t frame[])
+{
+  const uint32_t field = frame[gcPageSize] | (frame[gcPageSize+1u]<<8u);
+  return (field & 0xFFC0u) | ((field & 0x3Fu)<<16u);
+}
+
+void FrameBuild(const uint8_t page[],uint32_t addr,uint8_t frame[])
+{
+  const uint16_t field = (addr & 0xFFC0u) | ((addr >> 16u) & 0x3Fu);
+  memcpy(frame,page,gcPageSize);
+  frame[gcPageSize]    = field & 0xFFu;
+  frame[gcPageSize+1u] = field >> 8u;
+  const uint16_t crc   = Crc16(frame,gcPageSize+gcAddrSize);
+  frame[gcPageSize+gcAddrSize]    = crc & 0xFFu;
+  frame[gcPageSize+gcAddrSize+1u] = crc >> 8u;
+}
+
+bool PageIsCompact(const uint8_t page[])
+{
+  return BitReader(page).Read(12u) == 0xFFFu;
+}
+
+/*
+ * append one csv line per sample slot of a raw page
+ *   R,station,addr,slot,light,prescaler,usol,pressure,temperature,humidity,housing,status,ubat
+ * or one line per record of a compact page
+ *   C,station,addr,stamp,span,lightMin,lightMax,lumOff,lumOn,lumShare,usol,pressure,tempMin,tempMax,tempMean,humidity,ubat
+ * Values are raw as stored on the station, missing values are left empty.
+ */
+void PageDecode(uint32_t station,uint32_t addr,const uint8_t page[],std::string &out)
+{
+  BitReader bits(page);
+  if(PageIsCompact(page))
+  {
+    bits.Read(12u);
+    for(unsigned i=0u;i<3u;i++)
+    {
+      const unsigned stamp = bits.Read(16u);
+      const unsigned span  = bits.Read(8u);
+      unsigned values[12];
+      for(unsigned j=0u;j<2u;j++)
+        values[j] = bits.Read(11u);
+      for(unsigned j=2u;j<4u;j++)
+        values[j] = bits.Read(10u);
+      values[4] = bits.Read(6u);
+      for(unsigned j=5u;j<10u;j++)
+        values[j] = bits.Read(10u);
+      values[10] = bits.Read(8u);
+      values[11] = bits.Read(10u);
+      if(span==0u)
+        continue;
+
+      out += 'C';
+      AppendField(out,station);
+      AppendField(out,addr);
+      AppendField(out,stamp);
+      AppendField(out,span);
+      for(unsigned j=0u;j<12u;j++)
+        AppendField(out,values[j]);
+      out += '\n';
+    }
+    return;
+  }
+
+  for(unsigned slot=10u;slot<=200u;slot+=10u)
+  {
+    out += 'R';
+    AppendField(out,station);
+    AppendField(out,addr);
+    AppendField(out,slot);
+    AppendField(out,bits.Read(10u));
+    AppendField(out,bits.Read(2u));
+    if(slot%20u == 0u)
+    {
+      AppendField(out,bits.Read(10u));
+      AppendField(out,bits.Read(10u));
+    }
+    else
+    {
+      out += ",,";
+    }
+    if(slot%50u == 0u)
+    {
+      AppendField(out,bits.Read(10u));
+    }
+    else
+    {
+      out += ',';
+    }
+    if(slot == 200u)
+    {
+      AppendField(out,bits.Read(8u));
+      AppendField(out,bits.Read(8u));
+      AppendField(out,bits.Read(2u));
+      AppendField(out,bits.Read(10u));
+    }
+    else
+    {
+      out += ",,,,";
+    }
+    out += '\n';
+  }
+}
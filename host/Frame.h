@@ -0,0 +1,45 @@
+/////////////////////////////////////////////////////////////////////////////////////////
+//    This file is part of Solar.
+//
+//    Copyright (C) 2021 Matthias Hund
+//    
+//    This program is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU General Public License
+//    as published by the Free Software Foundation; either version 2
+//    of the License, or (at your option) any later version.
+//    
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//    
+//    You should have received a copy of the GNU General Public License
+//    along with this program; if not, write to the Free Software
+//    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+/////////////////////////////////////////////////////////////////////////////////////////
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*
+ * Layout of the data sent by the station, see TransmitBlock() and
+ * WhatNeedsToBeWritten() in Solar.ino and Compaction.h.
+ */
+const size_t gcPageSize     = 64u;
+const size_t gcAddrSize     = 2u;
+const size_t gcCrcSize      = 2u;
+const size_t gcFrameSize    = gcPageSize+gcAddrSize+gcCrcSize;
+
+uint16_t  Crc16(const uint8_t data[],size_t n);
+bool      FrameCrcValid(const uint8_t frame[]);
+uint16_t  FrameCrc(const uint8_t frame[]);
+uint32_t  FrameAddr(const uint8_t frame[]);
+void      FrameBuild(const uint8_t page[],uint32_t addr,uint8_t frame[]);
+
+bool      PageIsCompact(const uint8_t page[]);
+void      PageDecode(uint32_t station,uint32_t addr,const uint8_t page[],std::string &out);
+
+#endif // FRAME_H
@@ -0,0 +1,902 @@
+/////////////////////////////////////////////////////////////////////////////////////////
+//    This file is part of Solar.
+//
+//    Copyright (C) 2021 Matthias Hund
+//    
+//    This program is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU General Public License
+//    as published by the Free Software Foundation; either version 2
+//    of the License, or (at your option) any later version.
+//    
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//    
+//    You should have received a copy of the GNU General Public License
+//    along with this program; if not, write to the Free Software
+//    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+/////////////////////////////////////////////////////////////////////////////////////////
+//
+//  Ingest server for the pages uploaded by the stations.
+//
+//  A gateway connects via TCP, sends "STA<station id>\n" and then streams the
+//  frames it received from the station through GET (64 byte page, 2 byte
+//  address, CRC16). Frames are validated in batches, retransmitted pages are
+//  dropped per station and address, and the bit streams are decoded to csv
+//  on a work stealing thread pool.
+//
+//  build:  g++ -std=c++11 -O2 -pthread SolarIngest.cpp Frame.cpp WorkStealingPool.cpp -o solar_ingest
+//
+//  usage:  solar_ingest serve [-p port] [-a bind addr] [-t threads] [-b max frames in flight]
+//                             [-o csv file | -n] [-s stats interval in s]
+//          solar_ingest bench [-h host] [-p port] [-c stations] [-f frames per station]
+//                             [-t threads] [-d duplicate rate]
+//          solar_ingest check [-p port] [-t threads] [-c stations] [-f page versions per station]
+/////////////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "Frame.h"
+#include "WorkStealingPool.h"
+
+typedef std::chrono::steady_clock Clock;
+
+// ##### statistics #####
+
+enum STAGE {STAGE_RECEIVE,STAGE_QUEUE,STAGE_CRC,STAGE_DEDUP,STAGE_DECODE,STAGE_OUTPUT,STAGE_COUNT};
+
+static const char * const gcStageNames[STAGE_COUNT] = {"receive","queue","crc","dedup","decode","output"};
+
+struct StageStats
+{
+  std::atomic<uint64_t> frames;
+  std::atomic<uint64_t> nanos;
+  std::atomic<uint64_t> maxNanos;
+};
+
+static StageStats             gStages[STAGE_COUNT];
+static std::atomic<uint64_t>  gBytesIn(0u);
+static std::atomic<uint64_t>  gCrcErrors(0u);
+static std::atomic<uint64_t>  gDuplicates(0u);
+static std::atomic<uint64_t>  gPaused(0u);
+static std::atomic<size_t>    gInFlight(0u);
+static std::atomic<bool>      gStop(false);
+
+static uint64_t Nanos(const Clock::time_point start,const Clock::time_point end)
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(end-start).count();
+}
+
+static void StageAdd(const STAGE stage,const uint64_t frames,const uint64_t nanos)
+{
+  StageStats &s = gStages[stage];
+  s.frames += frames;
+  s.nanos  += nanos;
+  uint64_t max = s.maxNanos.load();
+  while(nanos>max and !s.maxNanos.compare_exchange_weak(max,nanos))
+  {
+  }
+}
+
+/*
+ * print throughput and latency of every stage since the last call
+ */
+static void PrintStats(const double seconds,const uint64_t steals)
+{
+  static uint64_t lastFrames[STAGE_COUNT];
+  static uint64_t lastNanos[STAGE_COUNT];
+
+  fprintf(stderr,"in %.1f MB  crc errors %llu  duplicates %llu  in flight %zu  paused %llu  steals %llu\n",
+          gBytesIn/1.0e6,(unsigned long long)gCrcErrors,(unsigned long long)gDuplicates,
+          gInFlight.load(),(unsigned long long)gPaused,(unsigned long long)steals);
+  for(unsigned i=0u;i<STAGE_COUNT;i++)
+  {
+    const uint64_t frames = gStages[i].frames;
+    const uint64_t nanos  = gStages[i].nanos;
+    const uint64_t dF     = frames-lastFrames[i];
+    const uint64_t dN     = nanos-lastNanos[i];
+    fprintf(stderr,"  %-8s %12llu frames %10.0f frames/s  avg %8.3f us  max %8.3f us\n",
+            gcStageNames[i],(unsigned long long)frames,dF/seconds,
+            dF ? dN/1.0e3/dF : 0.0,gStages[i].maxNanos.exchange(0u)/1.0e3);
+    lastFrames[i] = frames;
+    lastNanos[i]  = nanos;
+  }
+}
+
+// ##### deduplication #####
+
+/*
+ * remembers the crc of the last page seen per station and address. A page with
+ * the same crc is a retransmission, a different crc means the ring buffer of
+ * the station wrapped around.
+ */
+class PageIndex
+{
+public:
+  bool IsNew(const uint32_t station,const uint32_t addr,const uint16_t crc)
+  {
+    const uint64_t key   = (static_cast<uint64_t>(station)<<32u) | addr;
+    Shard         &shard = mShards[(key ^ (key>>29u)) % gcShards];
+    std::lock_guard<std::mutex> guard(shard.lock);
+    auto res = shard.crcs.emplace(key,crc);
+    if(res.second)
+      return true;
+    if(res.first->second == crc)
+      return false;
+    res.first->second = crc;
+    return true;
+  }
+
+private:
+  static const unsigned gcShards = 64u;
+
+  struct Shard
+  {
+    std::mutex                              lock;
+    std::unordered_map<uint64_t,uint16_t>   crcs;
+  };
+
+  Shard mShards[gcShards];
+};
+
+// ##### decode pipeline #####
+
+struct Batch
+{
+  uint32_t              station;
+  Clock::time_point     received;
+  std::vector<uint8_t>  frames;
+};
+
+class Sink
+{
+public:
+  explicit Sink(FILE *file) : mFile(file) {}
+
+  void Write(const std::string &data)
+  {
+    if(mFile==NULL or data.empty())
+      return;
+    std::lock_guard<std::mutex> guard(mLock);
+    fwrite(data.data(),1u,data.size(),mFile);
+  }
+
+private:
+  FILE       *mFile;
+  std::mutex  mLock;
+};
+
+static void ProcessBatch(const Batch &batch,PageIndex &index,Sink &sink)
+{
+  const size_t      count   = batch.frames.size()/gcFrameSize;
+  Clock::time_point start   = Clock::now();
+  StageAdd(STAGE_QUEUE,count,Nanos(batch.received,start));
+
+  std::vector<uint8_t> valid(count);
+  size_t crcErrors = 0u;
+  for(size_t i=0u;i<count;i++)
+  {
+    valid[i] = FrameCrcValid(&batch.frames[i*gcFrameSize]);
+    crcErrors += !valid[i];
+  }
+  gCrcErrors += crcErrors;
+  Clock::time_point end = Clock::now();
+  StageAdd(STAGE_CRC,count,Nanos(start,end));
+
+  start = end;
+  size_t duplicates = 0u;
+  for(size_t i=0u;i<count;i++)
+  {
+    const uint8_t *frame = &batch.frames[i*gcFrameSize];
+    if(valid[i] and !index.IsNew(batch.station,FrameAddr(frame),FrameCrc(frame)))
+    {
+      valid[i] = false;
+      duplicates++;
+    }
+  }
+  gDuplicates += duplicates;
+  end = Clock::now();
+  StageAdd(STAGE_DEDUP,count,Nanos(start,end));
+
+  start = end;
+  std::string out;
+  size_t decoded = 0u;
+  for(size_t i=0u;i<count;i++)
+  {
+    if(valid[i])
+    {
+      const uint8_t *frame = &batch.frames[i*gcFrameSize];
+      PageDecode(batch.station,FrameAddr(frame),frame,out);
+      decoded++;
+    }
+  }
+  end = Clock::now();
+  StageAdd(STAGE_DECODE,decoded,Nanos(start,end));
+
+  start = end;
+  sink.Write(out);
+  end = Clock::now();
+  StageAdd(STAGE_OUTPUT,decoded,Nanos(start,end));
+
+  gInFlight -= count;
+}
+
+/*
+ * The batches of one connection, processed one after the other in the order
+ * they were received. PageIndex only remembers the last crc per address, so a
+ * wrapped address has to be seen in order or a later retransmission is taken
+ * for a new page.
+ */
+struct Strand
+{
+  std::mutex                          lock;
+  std::deque<std::shared_ptr<Batch>>  batches;
+  bool                                running;  // a pool task works on the batches
+
+  Strand() : running(false) {}
+
+  bool Idle()
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    return !running and batches.empty();
+  }
+};
+
+/*
+ * process the oldest batch of a strand. If there are more, the strand queues
+ * up again behind the other connections instead of holding on to the worker.
+ */
+static void RunStrand(const std::shared_ptr<Strand> &strand,WorkStealingPool &pool,PageIndex &index,Sink &sink)
+{
+  std::shared_ptr<Batch> batch;
+  {
+    std::lock_guard<std::mutex> guard(strand->lock);
+    batch = strand->batches.front();
+    strand->batches.pop_front();
+  }
+  ProcessBatch(*batch,index,sink);
+
+  bool more = false;
+  {
+    std::lock_guard<std::mutex> guard(strand->lock);
+    more            = !strand->batches.empty();
+    strand->running = more;
+  }
+  if(more)
+    pool.Submit([strand,&pool,&index,&sink]{ RunStrand(strand,pool,index,sink); });
+}
+
+// ##### server #####
+
+struct Connection
+{
+  int                                   fd;
+  bool                                  hello;
+  bool                                  closing;  // peer is done, close once its batches are processed
+  uint32_t                              station;
+  std::shared_ptr<Strand>               strand;   // batches of this connection not processed yet
+  std::vector<uint8_t>                  buffer;
+};
+
+static void OnSignal(int)
+{
+  gStop = true;
+}
+
+static bool SetNonBlocking(const int fd)
+{
+  const int flags = fcntl(fd,F_GETFL,0);
+  return flags>=0 and fcntl(fd,F_SETFL,flags|O_NONBLOCK)==0;
+}
+
+static int Listen(const char *bindAddr,const uint16_t port)
+{
+  const int fd = socket(AF_INET,SOCK_STREAM,0);
+  if(fd<0)
+    return -1;
+  const int one = 1;
+  setsockopt(fd,SOL_SOCKET,SO_REUSEADDR,&one,sizeof(one));
+
+  sockaddr_in addr;
+  memset(&addr,0,sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port   = htons(port);
+  if(inet_pton(AF_INET,bindAddr,&addr.sin_addr)!=1 or
+     bind(fd,reinterpret_cast<sockaddr*>(&addr),sizeof(addr))!=0 or
+     listen(fd,SOMAXCONN)!=0 or
+     !SetNonBlocking(fd))
+  {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/*
+ * read what is available, handle the hello line and hand complete frames to the pool.
+ * returns false if the connection was closed.
+ */
+static bool ReadConnection(Connection &con,WorkStealingPool &pool,PageIndex &index,Sink &sink)
+{
+  uint8_t buf[65536];
+  const Clock::time_point start = Clock::now();
+  const ssize_t n = recv(con.fd,buf,sizeof(buf),0);
+  if(n==0 or (n<0 and errno!=EAGAIN and errno!=EWOULDBLOCK and errno!=EINTR))
+    return false;
+  if(n<0)
+    return true;
+  gBytesIn += n;
+  con.buffer.insert(con.buffer.end(),buf,buf+n);
+
+  size_t pos = 0u;
+  if(!con.hello)
+  {
+    auto nl = std::find(con.buffer.begin(),con.buffer.end(),'\n');
+    if(nl==con.buffer.end())
+      return con.buffer.size()<64u;   // no frames before the station is known
+    const std::string line(con.buffer.begin(),nl);
+    if(line.compare(0,3,"STA")!=0)
+      return false;
+    con.station = strtoul(line.c_str()+3,NULL,10);
+    con.hello   = true;
+    pos         = nl-con.buffer.begin()+1u;
+  }
+
+  const size_t count = (con.buffer.size()-pos)/gcFrameSize;
+  if(count>0u)
+  {
+    std::shared_ptr<Batch> batch(new Batch);
+    batch->station  = con.station;
+    batch->received = start;
+    batch->frames.assign(con.buffer.begin()+pos,con.buffer.begin()+pos+count*gcFrameSize);
+    pos += count*gcFrameSize;
+    gInFlight += count;
+    StageAdd(STAGE_RECEIVE,count,Nanos(start,Clock::now()));
+    std::shared_ptr<Strand> strand = con.strand;
+    bool start = false;
+    {
+      std::lock_guard<std::mutex> guard(strand->lock);
+      strand->batches.push_back(batch);
+      start = !strand->running;
+      strand->running = true;
+    }
+    if(start)
+      pool.Submit([strand,&pool,&index,&sink]{ RunStrand(strand,pool,index,sink); });
+  }
+  con.buffer.erase(con.buffer.begin(),con.buffer.begin()+pos);
+  return true;
+}
+
+static int Serve(int argc,char *argv[])
+{
+  uint16_t     port       = 5000u;
+  const char  *bindAddr   = "127.0.0.1";
+  unsigned     threads    = std::max(1u,std::thread::hardware_concurrency());
+  size_t       maxFlight  = 1u<<18u;
+  const char  *outName    = NULL;
+  bool         discard    = false;
+  unsigned     interval   = 5u;
+
+  for(int i=0;i<argc;i++)
+  {
+    const bool arg = i+1<argc;
+    if(strcmp(argv[i],"-p")==0 and arg)       port      = atoi(argv[++i]);
+    else if(strcmp(argv[i],"-a")==0 and arg)  bindAddr  = argv[++i];
+    else if(strcmp(argv[i],"-t")==0 and arg)  threads   = atoi(argv[++i]);
+    else if(strcmp(argv[i],"-b")==0 and arg)  maxFlight = atol(argv[++i]);
+    else if(strcmp(argv[i],"-o")==0 and arg)  outName   = argv[++i];
+    else if(strcmp(argv[i],"-s")==0 and arg)  interval  = atoi(argv[++i]);
+    else if(strcmp(argv[i],"-n")==0)          discard   = true;
+    else
+    {
+      fprintf(stderr,"unknown option %s\n",argv[i]);
+      return 1;
+    }
+  }
+
+  FILE *out = discard ? NULL : (outName ? fopen(outName,"w") : stdout);
+  if(!discard and out==NULL)
+  {
+    perror(outName);
+    return 1;
+  }
+
+  const int listenFd = Listen(bindAddr,port);
+  if(listenFd<0)
+  {
+    perror("listen");
+    return 1;
+  }
+  signal(SIGINT,OnSignal);
+  signal(SIGTERM,OnSignal);
+  signal(SIGPIPE,SIG_IGN);
+  fprintf(stderr,"listening on %s:%u with %u threads\n",bindAddr,port,threads);
+
+  Sink                    sink(out);
+  PageIndex               index;
+  WorkStealingPool        pool(threads);
+  std::vector<Connection> cons;
+  std::vector<pollfd>     fds;
+  bool                    paused    = false;
+  Clock::time_point       lastStats = Clock::now();
+
+  while(!gStop)
+  {
+    // stop reading while the pool is behind, TCP flow control slows the gateways down
+    const bool full = gInFlight>=maxFlight;
+    if(full and !paused)
+      gPaused++;
+    paused = full;
+
+    // the peer of a closing connection waits for the close, it tells the
+    // gateway that all of its frames have been processed
+    bool closing = false;
+    for(size_t i=cons.size();i>0u;i--)
+    {
+      Connection &con = cons[i-1u];
+      if(con.closing and con.strand->Idle())
+      {
+        close(con.fd);
+        cons.erase(cons.begin()+(i-1u));
+      }
+      else
+      {
+        closing = closing or con.closing;
+      }
+    }
+
+    fds.resize(cons.size()+1u);
+    fds[0].fd     = listenFd;
+    fds[0].events = POLLIN;
+    for(size_t i=0u;i<cons.size();i++)
+    {
+      fds[i+1u].fd     = cons[i].closing ? -1 : cons[i].fd;
+      fds[i+1u].events = paused ? 0 : POLLIN;
+    }
+
+    if(poll(fds.data(),fds.size(),(paused or closing) ? 1 : 100)>0)
+    {
+      for(size_t i=0u;i<cons.size();i++)
+      {
+        if(fds[i+1u].revents!=0 and !ReadConnection(cons[i],pool,index,sink))
+          cons[i].closing = true;
+      }
+      if(fds[0].revents & POLLIN)
+      {
+        int fd;
+        while((fd = accept(listenFd,NULL,NULL))>=0)
+        {
+          SetNonBlocking(fd);
+          Connection con;
+          con.fd      = fd;
+          con.hello   = false;
+          con.closing = false;
+          con.station = 0u;
+          con.strand  = std::make_shared<Strand>();
+          cons.push_back(con);
+        }
+      }
+    }
+
+    const Clock::time_point now = Clock::now();
+    if(interval>0u and now-lastStats>=std::chrono::seconds(interval))
+    {
+      PrintStats(Nanos(lastStats,now)/1.0e9,pool.Steals());
+      lastStats = now;
+    }
+  }
+
+  for(Connection &con : cons)
+  {
+    close(con.fd);
+  }
+  close(listenFd);
+  pool.Stop();
+  PrintStats(std::max(1.0e-9,Nanos(lastStats,Clock::now())/1.0e9),pool.Steals());
+  if(out!=NULL and out!=stdout)
+    fclose(out);
+  return 0;
+}
+
+// ##### synthetic load #####
+
+class BitWriter
+{
+public:
+  explicit BitWriter(uint8_t data[]) : mData(data), mIdx(0u) {}
+
+  void Write(const uint16_t value,const unsigned bits)
+  {
+    for(unsigned i=bits;i>0u;i--,mIdx++)
+    {
+      if(value & (1u<<(i-1u)))
+        mData[mIdx/8u] |= 0x80u>>(mIdx%8u);
+    }
+  }
+
+private:
+  uint8_t  *mData;
+  unsigned  mIdx;
+};
+
+/*
+ * a raw page with the layout written by WriteEeprom()
+ */
+static void GeneratePage(std::mt19937 &rng,uint8_t page[])
+{
+  memset(page,0,gcPageSize);
+  BitWriter bits(page);
+  const uint16_t base = rng()%900u;
+  for(unsigned slot=10u;slot<=200u;slot+=10u)
+  {
+    bits.Write((base+rng()%100u)&0x3FFu,10u);
+    bits.Write(rng()%2u,2u);
+    if(slot%20u == 0u)
+    {
+      bits.Write(rng()%1024u,10u);
+      bits.Write(rng()%1024u,10u);
+    }
+    if(slot%50u == 0u)
+    {
+      bits.Write(rng()%1024u,10u);
+      if(slot == 200u)
+      {
+        bits.Write(rng()%201u,8u);
+        bits.Write(rng()%251u,8u);
+        bits.Write(rng()%4u,2u);
+        bits.Write(rng()%1024u,10u);
+      }
+    }
+  }
+}
+
+static int Connect(const char *host,const uint16_t port)
+{
+  const int fd = socket(AF_INET,SOCK_STREAM,0);
+  sockaddr_in addr;
+  memset(&addr,0,sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port   = htons(port);
+  if(fd<0 or inet_pton(AF_INET,host,&addr.sin_addr)!=1 or
+     connect(fd,reinterpret_cast<sockaddr*>(&addr),sizeof(addr))!=0)
+  {
+    if(fd>=0)
+      close(fd);
+    return -1;
+  }
+  const int one = 1;
+  setsockopt(fd,IPPROTO_TCP,TCP_NODELAY,&one,sizeof(one));
+  return fd;
+}
+
+static bool SendAll(const int fd,const uint8_t *data,size_t n)
+{
+  while(n>0u)
+  {
+    const ssize_t sent = send(fd,data,n,0);
+    if(sent<=0)
+      return false;
+    data += sent;
+    n    -= sent;
+  }
+  return true;
+}
+
+/*
+ * every thread plays a couple of stations. Frames are generated in advance, the
+ * pages of a station wrap around after 2048 addresses like a 128 KB eeprom.
+ * After sending, a station shuts down its side and waits for the server to
+ * close the connection, which happens once all of its frames are processed.
+ */
+static void BenchThread(const char *host,const uint16_t port,const unsigned first,const unsigned count,
+                        const size_t frames,const double dupRate,std::atomic<unsigned> &ready,
+                        std::atomic<uint64_t> &sent)
+{
+  const size_t chunk = 1024u;
+  std::mt19937 rng(first*7919u+1u);
+  std::vector<int> fds;
+  std::vector<std::vector<uint8_t>> data(count);
+
+  for(unsigned s=0u;s<count;s++)
+  {
+    const int fd = Connect(host,port);
+    if(fd<0)
+    {
+      perror("connect");
+      ready++;
+      return;
+    }
+    const std::string hello = "STA"+std::to_string(first+s)+"\n";
+    SendAll(fd,reinterpret_cast<const uint8_t*>(hello.data()),hello.size());
+    fds.push_back(fd);
+
+    std::vector<uint8_t> &buf = data[s];
+    buf.resize(frames*gcFrameSize);
+    uint8_t page[gcPageSize];
+    for(size_t i=0u;i<frames;i++)
+    {
+      uint8_t *frame = &buf[i*gcFrameSize];
+      if(i>0u and rng()%1000000u < dupRate*1000000u)
+      {
+        memcpy(frame,frame-gcFrameSize,gcFrameSize);  // retransmission
+      }
+      else
+      {
+        GeneratePage(rng,page);
+        FrameBuild(page,(i%2048u)*gcPageSize,frame);
+      }
+    }
+  }
+
+  ready++;
+  while(ready!=0u)
+  {
+    std::this_thread::yield();
+  }
+
+  for(size_t pos=0u;pos<frames;pos+=chunk)
+  {
+    const size_t n = std::min(chunk,frames-pos);
+    for(unsigned s=0u;s<count;s++)
+    {
+      if(!SendAll(fds[s],&data[s][pos*gcFrameSize],n*gcFrameSize))
+        return;
+      sent += n;
+    }
+  }
+  for(const int fd : fds)
+  {
+    shutdown(fd,SHUT_WR);
+  }
+  for(const int fd : fds)
+  {
+    uint8_t buf[64];
+    while(recv(fd,buf,sizeof(buf),0)>0)
+    {
+    }
+    close(fd);
+  }
+}
+
+static int Bench(int argc,char *argv[])
+{
+  const char  *host     = "127.0.0.1";
+  uint16_t     port     = 5000u;
+  unsigned     stations = 64u;
+  size_t       frames   = 20000u;
+  unsigned     threads  = std::max(1u,std::thread::hardware_concurrency()/2u);
+  double       dupRate  = 0.05;
+
+  for(int i=0;i<argc;i++)
+  {
+    const bool arg = i+1<argc;
+    if(strcmp(argv[i],"-h")==0 and arg)       host      = argv[++i];
+    else if(strcmp(argv[i],"-p")==0 and arg)  port      = atoi(argv[++i]);
+    else if(strcmp(argv[i],"-c")==0 and arg)  stations  = atoi(argv[++i]);
+    else if(strcmp(argv[i],"-f")==0 and arg)  frames    = atol(argv[++i]);
+    else if(strcmp(argv[i],"-t")==0 and arg)  threads   = atoi(argv[++i]);
+    else if(strcmp(argv[i],"-d")==0 and arg)  dupRate   = atof(argv[++i]);
+    else
+    {
+      fprintf(stderr,"unknown option %s\n",argv[i]);
+      return 1;
+    }
+  }
+  threads = std::max(1u,std::min(threads,stations));
+
+  fprintf(stderr,"generating %zu frames for %u stations\n",frames*stations,stations);
+  std::atomic<unsigned>     ready(0u);
+  std::atomic<uint64_t>     sent(0u);
+  std::vector<std::thread>  workers;
+  for(unsigned t=0u;t<threads;t++)
+  {
+    const unsigned first = stations*t/threads;
+    const unsigned count = stations*(t+1u)/threads-first;
+    workers.emplace_back(BenchThread,host,port,first,count,frames,dupRate,std::ref(ready),std::ref(sent));
+  }
+  while(ready!=threads)
+  {
+    std::this_thread::yield();
+  }
+  const Clock::time_point start = Clock::now();
+  ready = 0u;   // all frames generated, start sending
+  for(std::thread &worker : workers)
+  {
+    worker.join();
+  }
+  const double seconds = Nanos(start,Clock::now())/1.0e9;
+  fprintf(stderr,"%llu frames sent and processed in %.2f s, %.0f frames/s\n",
+          (unsigned long long)sent.load(),seconds,sent/seconds);
+  return 0;
+}
+
+// ##### order check #####
+
+static const unsigned gcCheckAddrs = 4u;  // addresses of a station in the check, wraps after 4 pages
+
+/*
+ * one station sends versions 0..versions-1 of its pages, version v at address
+ * v%gcCheckAddrs. The light of slot 10 carries the version. Now and then a page
+ * still current at its address is sent again, like a gateway retrying a GET.
+ * Every frame goes out with its own send() so the server sees many batches.
+ */
+static void CheckStation(const uint16_t port,const unsigned station,const unsigned versions,
+                         std::atomic<uint64_t> &resent,std::atomic<unsigned> &failed)
+{
+  int fd = -1;
+  for(unsigned i=0u;i<100u and fd<0;i++)   // the server may not listen yet
+  {
+    fd = Connect("127.0.0.1",port);
+    if(fd<0)
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  if(fd<0)
+  {
+    failed++;
+    return;
+  }
+  const std::string hello = "STA"+std::to_string(station)+"\n";
+  SendAll(fd,reinterpret_cast<const uint8_t*>(hello.data()),hello.size());
+
+  std::mt19937 rng(station);
+  std::vector<uint8_t> frames(versions*gcFrameSize);
+  for(unsigned v=0u;v<versions;v++)
+  {
+    uint8_t page[gcPageSize];
+    GeneratePage(rng,page);
+    page[0] = (v>>2u) & 0xFFu;
+    page[1] = (page[1] & 0x3Fu) | ((v & 0x3u)<<6u);
+    FrameBuild(page,(v%gcCheckAddrs)*gcPageSize,&frames[v*gcFrameSize]);
+    SendAll(fd,&frames[v*gcFrameSize],gcFrameSize);
+
+    if(rng()%4u == 0u)
+    {
+      const unsigned old = v-rng()%std::min(v+1u,gcCheckAddrs);   // not yet overwritten
+      SendAll(fd,&frames[old*gcFrameSize],gcFrameSize);
+      resent++;
+    }
+    if(v%16u == 0u)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  shutdown(fd,SHUT_WR);
+  uint8_t buf[64];
+  while(recv(fd,buf,sizeof(buf),0)>0)
+  {
+  }
+  close(fd);
+}
+
+/*
+ * run the server and a couple of stations in this process and check that every
+ * page version is written exactly once and every retransmission is dropped
+ */
+static int Check(int argc,char *argv[])
+{
+  uint16_t  port      = 5099u;
+  unsigned  threads   = 4u;
+  unsigned  stations  = 16u;
+  unsigned  versions  = 1000u;
+
+  for(int i=0;i<argc;i++)
+  {
+    const bool arg = i+1<argc;
+    if(strcmp(argv[i],"-p")==0 and arg)       port      = atoi(argv[++i]);
+    else if(strcmp(argv[i],"-t")==0 and arg)  threads   = atoi(argv[++i]);
+    else if(strcmp(argv[i],"-c")==0 and arg)  stations  = atoi(argv[++i]);
+    else if(strcmp(argv[i],"-f")==0 and arg)  versions  = std::min(1024,atoi(argv[++i]));
+    else
+    {
+      fprintf(stderr,"unknown option %s\n",argv[i]);
+      return 1;
+    }
+  }
+
+  char path[] = "/tmp/solar_ingest_XXXXXX";
+  const int tmp = mkstemp(path);
+  if(tmp<0)
+  {
+    perror("mkstemp");
+    return 1;
+  }
+  close(tmp);
+
+  std::vector<std::string> args = {"-p",std::to_string(port),"-t",std::to_string(threads),"-o",path,"-s","0"};
+  std::vector<char*>       serveArgs;
+  for(std::string &arg : args)
+  {
+    serveArgs.push_back(&arg[0]);
+  }
+  std::thread server(Serve,static_cast<int>(serveArgs.size()),serveArgs.data());
+
+  std::atomic<uint64_t>     resent(0u);
+  std::atomic<unsigned>     failed(0u);
+  std::vector<std::thread>  clients;
+  for(unsigned s=0u;s<stations;s++)
+  {
+    clients.emplace_back(CheckStation,port,s,versions,std::ref(resent),std::ref(failed));
+  }
+  for(std::thread &client : clients)
+  {
+    client.join();
+  }
+  gStop = true;
+  server.join();
+
+  std::map<std::pair<unsigned,unsigned>,unsigned> lines;  // station and version
+  FILE *in = fopen(path,"r");
+  char  line[256];
+  while(in!=NULL and fgets(line,sizeof(line),in)!=NULL)
+  {
+    unsigned station,addr,slot,light;
+    if(sscanf(line,"R,%u,%u,%u,%u",&station,&addr,&slot,&light)==4 and slot==10u)
+    {
+      if(addr!=(light%gcCheckAddrs)*gcPageSize)
+        failed++;
+      lines[std::make_pair(station,light)]++;
+    }
+  }
+  if(in!=NULL)
+    fclose(in);
+  unlink(path);
+
+  for(unsigned s=0u;s<stations;s++)
+  {
+    for(unsigned v=0u;v<versions;v++)
+    {
+      auto it = lines.find(std::make_pair(s,v));
+      const unsigned n = (it==lines.end()) ? 0u : it->second;
+      if(n!=1u)
+      {
+        if(failed<10u)
+          fprintf(stderr,"station %u version %u written %u times\n",s,v,n);
+        failed++;
+      }
+    }
+  }
+  if(gDuplicates!=resent)
+  {
+    fprintf(stderr,"%llu retransmissions sent, %llu dropped\n",(unsigned long long)resent.load(),(unsigned long long)gDuplicates.load());
+    failed++;
+  }
+  fprintf(stderr,"%s: %u stations, %u page versions each, %llu retransmissions\n",
+          failed ? "check failed" : "check passed",stations,versions,(unsigned long long)resent.load());
+  return failed ? 1 : 0;
+}
+
+int main(int argc,char *argv[])
+{
+  if(argc>=2 and strcmp(argv[1],"serve")==0)
+    return Serve(argc-2,argv+2);
+  if(argc>=2 and strcmp(argv[1],"bench")==0)
+    return Bench(argc-2,argv+2);
+  if(argc>=2 and strcmp(argv[1],"check")==0)
+    return Check(argc-2,argv+2);
+  fprintf(stderr,"usage: %s serve|bench|check [options]\n",argv[0]);
+  return 1;
+}
@@ -0,0 +1,341 @@
+/////////////////////////////////////////////////////////////////////////////////////////
+//    This file is part of Solar.
+//
+//    Copyright (C) 2021 Matthias Hund
+//    
+//    This program is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU General Public License
+//    as published by the Free Software Foundation; either version 2
+//    of the License, or (at your option) any later version.
+//    
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//    
+//    You should have received a copy of the GNU General Public License
+//    along with this program; if not, write to the Free Software
+//    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+/////////////////////////////////////////////////////////////////////////////////////////
+//
+//  Retention check of the eeprom ring buffer of the sketch.
+//
+//  EepromBuffer.cpp and Compaction.cpp of the sketch run on a simulated eeprom
+//  of a station that can not upload for a long time. Every cycle writes one
+//  page like WriteEeprom() does, the samples are derived from the cycle number.
+//  The queue is read back like the gateway does it (EepromNewPages(), then
+//  EepromGetPageAddr() for every page as in TransmitBlock()) and decoded with
+//  PageDecode(). Checked are:
+//   - pages and records are in time order without gaps, the newest raw page
+//     holds the last completed cycle
+//   - the span of the records never grows from old to new data
+//   - min, max and means of every record match the cycles it covers
+//   - the buffer stays full and the oldest retained cycle moves on by at most
+//     one page of the last tier per cycle
+//  Exits with 1 at the first failed check, else prints the retention per tier.
+//
+//  build:  g++ -std=c++11 -O2 -Ihost/arduino -I. host/SolarRetention.cpp EepromBuffer.cpp Compaction.cpp
+//              host/Frame.cpp -o solar_retention
+//
+//  usage:  solar_retention [-p eeprom pages] [-c cycles] [-u cycle of an upload] [-k cycles between full checks]
+/////////////////////////////////////////////////////////////////////////////////////////
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "ExtEeprom.h"
+#include "EepromBuffer.h"
+#include "Compaction.h"
+#include "Frame.h"
+
+static const unsigned gcLastSpan      = 64u;     // span of the records of the last tier
+static const double   gcCycleSeconds  = 200.0*8.0;
+
+static std::vector<uint8_t> gMem;
+static uint16_t             gPages = 512u;
+
+#define CHECK(cond) Check((cond),#cond,__LINE__)
+
+static void Check(const bool cond,const char *text,const int line)
+{
+  if(!cond)
+  {
+    fprintf(stderr,"check failed in line %d: %s (cycle %u)\n",line,text,EepromGetCycle());
+    exit(1);
+  }
+}
+
+// ##### simulated eeprom #####
+
+uint16_t EEPROM_I2C_pages()
+{
+  return gPages;
+}
+
+bool EEPROM_I2C_write8(uint32_t addr,uint8_t value)
+{
+  CHECK(addr<EepromBufferPages()*gcEepromPageSize);   // the aggregate pages are not part of the buffer
+  gMem[addr] = value;
+  return true;
+}
+
+uint8_t EEPROM_I2C_read8(uint32_t addr)
+{
+  return gMem[addr];
+}
+
+bool EEPROM_I2C_write(uint32_t addr,uint8_t data[],uint8_t dataSize)
+{
+  CHECK(addr+dataSize<=EepromBufferPages()*gcEepromPageSize);
+  memcpy(&gMem[addr],data,dataSize);
+  return true;
+}
+
+uint8_t EEPROM_I2C_read(uint32_t addr,uint8_t data[],uint8_t dataSize)
+{
+  CHECK(addr+dataSize<=gMem.size());
+  memcpy(data,&gMem[addr],dataSize);
+  return dataSize;
+}
+
+void SignalLED(const LED_SIGNAL)
+{
+}
+
+// ##### station #####
+
+static unsigned Value(const unsigned cycle)
+{
+  return cycle%1000u;
+}
+
+/*
+ * the bit stream of one cycle in the order of WhatNeedsToBeWritten(). Every
+ * other light sample is taken with prescaler on and a constant lum of 100.
+ */
+static void WriteCycle(const unsigned cycle)
+{
+  const unsigned v = Value(cycle);
+  for(unsigned slot=10u;slot<=200u;slot+=10u)
+  {
+    EepromBufferWriteBits(slot%20u==0u ? 100u : v,10u);
+    EepromBufferWriteBits(slot%20u==0u ? 1u : 0u,2u);
+    if(slot%20u == 0u)
+    {
+      EepromBufferWriteBits(v,10u);
+      EepromBufferWriteBits(v/2u,10u);
+    }
+    if(slot%50u == 0u)
+    {
+      EepromBufferWriteBits(v,10u);
+      if(slot == 200u)
+      {
+        EepromBufferWriteBits(50u,8u);
+        EepromBufferWriteBits(1u,8u);
+        EepromBufferWriteBits(0u,2u);
+        EepromBufferWriteBits(v,10u);
+      }
+    }
+  }
+  EepromBufferFlash();
+}
+
+// ##### queue #####
+
+struct Record
+{
+  unsigned first;
+  unsigned last;
+  unsigned span;
+};
+
+static void DecodePage(const uint16_t page,std::string &out)
+{
+  uint8_t data[gcEepromPageSize];
+  const uint32_t addr = EepromGetPageAddr(page);
+  EEPROM_I2C_read(addr,data,sizeof(data));
+  out.clear();
+  PageDecode(0u,addr,data,out);
+}
+
+static bool Near(const unsigned value,const double mean)
+{
+  return value+1.0>=mean and value<=mean+1.0;
+}
+
+/*
+ * check one line of a compact page and return the record
+ */
+static Record CheckCompactLine(const char *line)
+{
+  unsigned f[16];
+  CHECK(sscanf(line,"C,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u",
+               &f[0],&f[1],&f[2],&f[3],&f[4],&f[5],&f[6],&f[7],&f[8],&f[9],&f[10],&f[11],&f[12],&f[13],&f[14],&f[15])==16);
+  Record rec;
+  rec.last  = f[2];
+  rec.span  = f[3];
+  rec.first = rec.last+1u-rec.span;
+  CHECK(rec.span==1u or rec.span==4u or rec.span==16u or rec.span==64u);
+
+  CHECK(f[5]==(1u<<10u)+100u);  // light max: prescaler on, lum 100
+  CHECK(f[7]==100u);            // lum mean with prescaler on
+  CHECK(f[8]==32u);             // half of the samples with prescaler on
+  CHECK(f[14]==50u);            // humidity
+  if(Value(rec.first)<=Value(rec.last))   // values do not wrap within the record
+  {
+    const double mean = (Value(rec.first)+Value(rec.last))/2.0;
+    CHECK(f[4]==Value(rec.first));        // light min
+    CHECK(Near(f[6],mean));               // lum mean with prescaler off
+    CHECK(Near(f[9],mean));               // Usol
+    CHECK(Near(f[10],mean/2.0));          // pressure
+    CHECK(f[11]==Value(rec.first));       // temperature min
+    CHECK(f[12]==Value(rec.last));        // temperature max
+    CHECK(Near(f[13],mean));              // temperature mean
+    CHECK(Near(f[15],mean));              // Ubat
+  }
+  return rec;
+}
+
+/*
+ * walk the queue from the oldest to the newest page. Returns the oldest cycle
+ * held, pagesBySpan and cyclesBySpan count the compact pages and covered cycles
+ * per record span, span 0 stands for raw pages.
+ */
+static unsigned CheckQueue(std::map<unsigned,unsigned> &pagesBySpan,std::map<unsigned,unsigned> &cyclesBySpan)
+{
+  const uint16_t  pages   = EepromNewPages(GET);
+  unsigned        next    = 0u;       // next cycle expected
+  unsigned        oldest  = EepromGetCycle();
+  unsigned        span    = 255u;
+  bool            first   = true;
+  std::string     out;
+
+  for(uint16_t page=pages;page>0u;page--)
+  {
+    DecodePage(page-1u,out);
+    if(out[0]=='C')
+    {
+      CHECK(span>0u);     // no compact page after a raw page
+      unsigned pageSpan = 0u;
+      for(size_t pos=0u;pos<out.size();pos=out.find('\n',pos)+1u)
+      {
+        const Record rec = CheckCompactLine(&out[pos]);
+        CHECK(rec.span<=span);
+        CHECK(pageSpan==0u or rec.span==pageSpan);  // a page holds records of one tier
+        CHECK(first or rec.first==next);
+        if(first)
+          oldest = rec.first;
+        first     = false;
+        next      = rec.last+1u;
+        span      = rec.span;
+        pageSpan  = rec.span;
+        cyclesBySpan[rec.span] += rec.span;
+      }
+      pagesBySpan[pageSpan]++;
+    }
+    else
+    {
+      unsigned values[4];
+      CHECK(sscanf(out.c_str(),"R,%u,%u,%u,%u",&values[0],&values[1],&values[2],&values[3])==4);
+      const unsigned cycle = EepromGetCycle()-page;
+      CHECK(values[3]==Value(cycle));
+      CHECK(first or cycle==next);
+      if(first)
+        oldest = cycle;
+      first = false;
+      next  = cycle+1u;
+      span  = 0u;
+      pagesBySpan[0u]++;
+      cyclesBySpan[0u]++;
+    }
+  }
+  CHECK(pages==0u or next==EepromGetCycle());
+  return oldest;
+}
+
+/*
+ * oldest cycle held, only reads the oldest page
+ */
+static unsigned OldestCycle()
+{
+  const uint16_t pages = EepromNewPages(GET);
+  if(pages==0u)
+    return EepromGetCycle();
+  std::string out;
+  DecodePage(pages-1u,out);
+  if(out[0]=='C')
+    return CheckCompactLine(out.c_str()).first;
+  return EepromGetCycle()-pages;
+}
+
+int main(int argc,char *argv[])
+{
+  unsigned cycles   = 20000u;
+  unsigned upload   = 500u;
+  unsigned interval = 50u;
+
+  for(int i=1;i<argc;i++)
+  {
+    const bool arg = i+1<argc;
+    if(strcmp(argv[i],"-p")==0 and arg)       gPages    = atoi(argv[++i]);
+    else if(strcmp(argv[i],"-c")==0 and arg)  cycles    = atoi(argv[++i]);
+    else if(strcmp(argv[i],"-u")==0 and arg)  upload    = atoi(argv[++i]);
+    else if(strcmp(argv[i],"-k")==0 and arg)  interval  = atoi(argv[++i]);
+    else
+    {
+      fprintf(stderr,"unknown option %s\n",argv[i]);
+      return 1;
+    }
+  }
+  CHECK(cycles<65536u and interval>0u);
+  gMem.assign(static_cast<size_t>(gPages)*gcEepromPageSize,0xFFu);
+
+  std::map<unsigned,unsigned> pagesBySpan;
+  std::map<unsigned,unsigned> cyclesBySpan;
+  unsigned oldest   = 0u;
+  bool     dropped  = false;    // the last tier dropped data
+
+  for(unsigned cycle=0u;cycle<cycles;cycle++)
+  {
+    WriteCycle(cycle);
+
+    const unsigned now = OldestCycle();
+    CHECK(now>=oldest and now-oldest<=gcCompactRecords*gcLastSpan);
+    dropped = dropped or now!=oldest;
+    oldest  = now;
+    if(dropped)   // buffer full: at most a few pages per tier are free
+      CHECK(EepromNewPages(GET)+5u*4u>=EepromBufferPages());
+
+    if(cycle%interval==0u or cycle+1u==cycles)
+    {
+      pagesBySpan.clear();
+      cyclesBySpan.clear();
+      CHECK(CheckQueue(pagesBySpan,cyclesBySpan)==oldest);
+    }
+    if(cycle+1u==upload)
+    {
+      EepromNewPages(RESET);
+      CHECK(EepromNewPages(GET)==0u);
+      oldest = EepromGetCycle();
+    }
+  }
+
+  printf("%u pages, %u cycles, upload after cycle %u\n",EepromBufferPages(),cycles,upload);
+  printf("  tier  span  pages    cycles     days\n");
+  unsigned total = 0u;
+  unsigned tier  = 0u;
+  for(auto it=pagesBySpan.begin();it!=pagesBySpan.end();++it)
+  {
+    const unsigned c = cyclesBySpan[it->first];
+    const std::string name = it->first==0u ? "raw" : std::to_string(tier++);
+    printf("  %-4s  %4u  %5u  %8u  %7.1f\n",name.c_str(),it->first==0u ? 1u : it->first,
+           it->second,c,c*gcCycleSeconds/86400.0);
+    total += c;
+  }
+  printf("  retained %u cycles, %.1f days, oldest data dropped: %s\n",total,total*gcCycleSeconds/86400.0,dropped ? "yes" : "no");
+  return 0;
+}
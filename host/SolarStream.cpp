@@ -0,0 +1,226 @@
+/////////////////////////////////////////////////////////////////////////////////////////
+//    This file is part of Solar.
+//
+//    Copyright (C) 2021 Matthias Hund
+//    
+//    This program is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU General Public License
+//    as published by the Free Software Foundation; either version 2
+//    of the License, or (at your option) any later version.
+//    
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//    
+//    You should have received a copy of the GNU General Public License
+//    along with this program; if not, write to the Free Software
+//    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+/////////////////////////////////////////////////////////////////////////////////////////
+//
+//  Reader for the telemetry stream of the debug mode (command STR, see
+//  StreamTelemetry() in Solar.ino). Prints one csv line per frame, the scale
+//  factors are the ones of GetUsol(), GetUbat() and GetTemperature().
+//
+//  build:  g++ -std=c++11 -O2 SolarStream.cpp Frame.cpp -o solar_stream
+//
+//  usage:  solar_stream [-d device] [-i interval in ms] [-m channel mask]
+//          solar_stream -d /dev/ttyUSB0 -i 100 -m 3 | tee calibration.csv
+/////////////////////////////////////////////////////////////////////////////////////////
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "Frame.h"
+
+enum STREAM_CHANNEL {STREAM_USOL,STREAM_UBAT,STREAM_TEMP,STREAM_LIGHT,STREAM_PRESSURE,STREAM_HUMIDITY,STREAM_HOUSING_TEMP,STREAM_CHANNELS};
+
+struct ChannelInfo
+{
+  const char *name;
+  double      scale;
+  double      offset;
+};
+
+static const ChannelInfo gcChannels[STREAM_CHANNELS] =
+{
+  {"usol_V",    0.0057767, 0.0},
+  {"ubat_V",    0.0036362, 0.0},
+  {"temp_C",    0.1064,  -39.0},
+  {"light",     1.0,       0.0},  // bit 10 = prescaler
+  {"pressure_hPa",0.1,     0.0},
+  {"humidity",  0.1,       0.0},
+  {"housing_C", 0.1,     -40.0},
+};
+
+static volatile sig_atomic_t gStop = 0;
+
+static void OnSignal(int)
+{
+  gStop = 1;
+}
+
+static int OpenPort(const char *device)
+{
+  const int fd = open(device,O_RDWR|O_NOCTTY);
+  if(fd<0)
+    return -1;
+
+  termios tio;
+  memset(&tio,0,sizeof(tio));
+  cfmakeraw(&tio);
+  cfsetispeed(&tio,B19200);
+  cfsetospeed(&tio,B19200);
+  tio.c_cflag |= CLOCAL|CREAD;
+  tio.c_cc[VMIN]  = 0;
+  tio.c_cc[VTIME] = 2;  // 0.2 s, lets the loop notice a signal
+  if(tcsetattr(fd,TCSANOW,&tio)!=0)
+  {
+    close(fd);
+    return -1;
+  }
+  tcflush(fd,TCIOFLUSH);
+  return fd;
+}
+
+static size_t FrameSize(const uint8_t mask)
+{
+  size_t n = 2u+2u+2u+1u+2u;
+  for(unsigned ch=0u;ch<STREAM_CHANNELS;ch++)
+  {
+    if(mask & (1u<<ch))
+      n += 2u;
+  }
+  return n;
+}
+
+static void PrintHeader(const uint8_t mask)
+{
+  printf("seq,time_ms");
+  for(unsigned ch=0u;ch<STREAM_CHANNELS;ch++)
+  {
+    if(mask & (1u<<ch))
+      printf(",%s_raw,%s",gcChannels[ch].name,gcChannels[ch].name);
+  }
+  printf("\n");
+}
+
+static void PrintFrame(const uint8_t frame[],const uint8_t mask,const unsigned long time)
+{
+  const unsigned seq = frame[2] | (frame[3]<<8u);
+  printf("%u,%lu",seq,time);
+  size_t pos = 7u;
+  for(unsigned ch=0u;ch<STREAM_CHANNELS;ch++)
+  {
+    if(mask & (1u<<ch))
+    {
+      const unsigned raw = frame[pos] | (frame[pos+1u]<<8u);
+      printf(",%u,%.4f",raw,raw*gcChannels[ch].scale+gcChannels[ch].offset);
+      pos += 2u;
+    }
+  }
+  printf("\n");
+  fflush(stdout);
+}
+
+int main(int argc,char *argv[])
+{
+  const char *device   = "/dev/ttyUSB0";
+  unsigned    interval = 200u;
+  unsigned    mask     = (1u<<STREAM_CHANNELS)-1u;
+
+  for(int i=1;i<argc;i++)
+  {
+    const bool arg = i+1<argc;
+    if(strcmp(argv[i],"-d")==0 and arg)       device    = argv[++i];
+    else if(strcmp(argv[i],"-i")==0 and arg)  interval  = atoi(argv[++i]);
+    else if(strcmp(argv[i],"-m")==0 and arg)  mask      = atoi(argv[++i]) & ((1u<<STREAM_CHANNELS)-1u);
+    else
+    {
+      fprintf(stderr,"usage: %s [-d device] [-i interval in ms] [-m channel mask]\n",argv[0]);
+      return 1;
+    }
+  }
+
+  const int fd = OpenPort(device);
+  if(fd<0)
+  {
+    perror(device);
+    return 1;
+  }
+  signal(SIGINT,OnSignal);
+  signal(SIGTERM,OnSignal);
+
+  const std::string cmd = "STR"+std::to_string(interval)+","+std::to_string(mask)+"\n";
+  if(write(fd,cmd.data(),cmd.size())!=static_cast<ssize_t>(cmd.size()))
+  {
+    perror("write");
+    return 1;
+  }
+  PrintHeader(mask);
+
+  const size_t          frameSize = FrameSize(mask);
+  std::vector<uint8_t>  buffer;
+  unsigned long         frames    = 0u;
+  unsigned long         crcErrors = 0u;
+  unsigned long         lost      = 0u;
+  unsigned long         time      = 0u;
+  int                   lastSeq   = -1;
+  int                   lastMs    = -1;
+
+  while(!gStop)
+  {
+    uint8_t buf[256];
+    const ssize_t n = read(fd,buf,sizeof(buf));
+    if(n<0)
+      break;
+    buffer.insert(buffer.end(),buf,buf+n);
+
+    size_t pos = 0u;
+    while(buffer.size()-pos>=frameSize)
+    {
+      const uint8_t *frame = &buffer[pos];
+      if(frame[0]!=0xA5u or frame[1]!=0x5Au or frame[6]!=mask)
+      {
+        pos++;    // search the next sync bytes
+        continue;
+      }
+      const uint16_t crc = frame[frameSize-2u] | (frame[frameSize-1u]<<8u);
+      if(Crc16(frame+2u,frameSize-4u)!=crc)
+      {
+        crcErrors++;
+        pos++;
+        continue;
+      }
+
+      const int seq = frame[2] | (frame[3]<<8u);
+      const int ms  = frame[4] | (frame[5]<<8u);
+      if(lastSeq>=0)
+      {
+        lost += (seq-lastSeq-1) & 0xFFFF;
+        time += (ms-lastMs) & 0xFFFF;
+      }
+      lastSeq = seq;
+      lastMs  = ms;
+      PrintFrame(frame,mask,time);
+      frames++;
+      pos += frameSize;
+    }
+    buffer.erase(buffer.begin(),buffer.begin()+pos);
+  }
+
+  const uint8_t stop = 'X';
+  if(write(fd,&stop,1u)!=1)
+    perror("write");
+  close(fd);
+  fprintf(stderr,"%lu frames, %lu lost, %lu crc errors\n",frames,lost,crcErrors);
+  return 0;
+}
@@ -0,0 +1,119 @@
+/////////////////////////////////////////////////////////////////////////////////////////
+//    This file is part of Solar.
+//
+//    Copyright (C) 2021 Matthias Hund
+//    
+//    This program is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU General Public License
+//    as published by the Free Software Foundation; either version 2
+//    of the License, or (at your option) any later version.
+//    
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//    
+//    You should have received a copy of the GNU General Public License
+//    along with this program; if not, write to the Free Software
+//    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+/////////////////////////////////////////////////////////////////////////////////////////
+#include "WorkStealingPool.h"
+
+#include <chrono>
+
+WorkStealingPool::WorkStealingPool(unsigned threads)
+  : mNext(0u), mPending(0u), mSteals(0u), mStop(false)
+{
+  if(threads==0u)
+    threads = 1u;
+  for(unsigned i=0u;i<threads;i++)
+  {
+    mQueues.emplace_back(new Queue);
+  }
+  for(unsigned i=0u;i<threads;i++)
+  {
+    mThreads.emplace_back(&WorkStealingPool::Run,this,i);
+  }
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+  Stop();
+}
+
+void WorkStealingPool::Submit(Task task)
+{
+  Queue &queue = *mQueues[mNext++ % mQueues.size()];
+  // count the task before it becomes visible, a worker may take it at once
+  mPending++;
+  {
+    std::lock_guard<std::mutex> guard(queue.lock);
+    queue.tasks.push_back(std::move(task));
+  }
+  mIdle.notify_one();
+}
+
+/*
+ * run the remaining tasks and join the workers
+ */
+void WorkStealingPool::Stop()
+{
+  if(mStop.exchange(true))
+    return;
+  mIdle.notify_all();
+  for(std::thread &thread : mThreads)
+  {
+    thread.join();
+  }
+}
+
+bool WorkStealingPool::Pop(unsigned self,Task &task)
+{
+  Queue &queue = *mQueues[self];
+  std::lock_guard<std::mutex> guard(queue.lock);
+  if(queue.tasks.empty())
+    return false;
+  task = std::move(queue.tasks.front());
+  queue.tasks.pop_front();
+  return true;
+}
+
+bool WorkStealingPool::Steal(unsigned self,Task &task)
+{
+  for(size_t i=1u;i<mQueues.size();i++)
+  {
+    Queue &queue = *mQueues[(self+i) % mQueues.size()];
+    std::unique_lock<std::mutex> guard(queue.lock,std::try_to_lock);
+    if(guard.owns_lock() and !queue.tasks.empty())
+    {
+      task = std::move(queue.tasks.front());
+      queue.tasks.pop_front();
+      mSteals++;
+      return true;
+    }
+  }
+  return false;
+}
+
+void WorkStealingPool::Run(unsigned self)
+{
+  Task task;
+  while(true)
+  {
+    if(Pop(self,task) or Steal(self,task))
+    {
+      mPending--;
+      task();
+      task = nullptr;
+    }
+    else if(mStop and mPending==0u)
+    {
+      break;
+    }
+    else
+    {
+      std::unique_lock<std::mutex> guard(mIdleLock);
+      mIdle.wait_for(guard,std::chrono::milliseconds(1),[this]{ return mPending>0u or mStop; });
+    }
+  }
+}
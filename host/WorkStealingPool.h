@@ -0,0 +1,72 @@
+/////////////////////////////////////////////////////////////////////////////////////////
+//    This file is part of Solar.
+//
+//    Copyright (C) 2021 Matthias Hund
+//    
+//    This program is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU General Public License
+//    as published by the Free Software Foundation; either version 2
+//    of the License, or (at your option) any later version.
+//    
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//    
+//    You should have received a copy of the GNU General Public License
+//    along with this program; if not, write to the Free Software
+//    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+/////////////////////////////////////////////////////////////////////////////////////////
+#ifndef WORK_STEALING_POOL_H
+#define WORK_STEALING_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Every worker owns a queue. Submitted tasks are distributed round robin, a
+ * worker takes the oldest task from its own queue and steals the oldest task
+ * from the other queues once its own queue is empty. Tasks run in about the
+ * order they were submitted, but tasks which must not overlap have to be
+ * serialized by the caller.
+ */
+class WorkStealingPool
+{
+public:
+  typedef std::function<void()> Task;
+
+  explicit WorkStealingPool(unsigned threads);
+  ~WorkStealingPool();
+
+  void      Submit(Task task);
+  void      Stop();
+  uint64_t  Steals() const { return mSteals.load(); }
+
+private:
+  struct Queue
+  {
+    std::mutex        lock;
+    std::deque<Task>  tasks;
+  };
+
+  bool  Pop(unsigned self,Task &task);
+  bool  Steal(unsigned self,Task &task);
+  void  Run(unsigned self);
+
+  std::vector<std::unique_ptr<Queue>> mQueues;
+  std::vector<std::thread>            mThreads;
+  std::atomic<unsigned>               mNext;
+  std::atomic<size_t>                 mPending;
+  std::atomic<uint64_t>               mSteals;
+  std::atomic<bool>                   mStop;
+  std::mutex                          mIdleLock;
+  std::condition_variable             mIdle;
+};
+
+#endif // WORK_STEALING_POOL_H